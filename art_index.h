@@ -0,0 +1,432 @@
+#pragma once
+
+#include "kv_common.h"
+
+// Ordered set of keys as an adaptive radix tree (Leis et al., ICDE 2013). Inner nodes
+// grow through 4/16/48/256-way layouts as children are added and shrink again on
+// removal. Single-child paths are collapsed into a node prefix, and leaves store the
+// whole key, so a lookup ends with one full compare. A key that is a proper prefix of
+// another sits in the `terminal` slot of the node where it ends.
+//
+// Not thread-safe; ShardedKVCache keeps one per shard under the shard lock.
+class ArtIndex {
+public:
+    ArtIndex() = default;
+    ArtIndex(const ArtIndex&) = delete;
+    ArtIndex& operator=(const ArtIndex&) = delete;
+
+    ~ArtIndex() {
+        destroy(root_);
+    }
+
+    size_t size() const { return size_; }
+
+    // Returns false if the key was already present.
+    bool insert(const string& key) {
+        Node** ref = &root_;
+        size_t depth = 0;
+        while (true) {
+            Node* node = *ref;
+            if (!node) {
+                *ref = new Leaf(key);
+                break;
+            }
+            if (node->type == kLeaf) {
+                Leaf* leaf = static_cast<Leaf*>(node);
+                if (leaf->key == key) return false;
+                size_t common = depth;
+                while (common < key.size() && common < leaf->key.size() && key[common] == leaf->key[common]) ++common;
+                Node4* split = new Node4;
+                split->prefix = key.substr(depth, common - depth);
+                attach(split, leaf, leaf->key, common);
+                attach(split, new Leaf(key), key, common);
+                *ref = split;
+                break;
+            }
+
+            Inner* inner = static_cast<Inner*>(node);
+            size_t matched = 0;
+            while (matched < inner->prefix.size() && depth + matched < key.size() &&
+                   inner->prefix[matched] == key[depth + matched]) {
+                ++matched;
+            }
+            if (matched < inner->prefix.size()) {
+                Node4* split = new Node4;
+                split->prefix = inner->prefix.substr(0, matched);
+                uint8_t byte = inner->prefix[matched];
+                inner->prefix.erase(0, matched + 1);
+                add_child(split, byte, inner);
+                attach(split, new Leaf(key), key, depth + matched);
+                *ref = split;
+                break;
+            }
+            depth += matched;
+            if (depth == key.size()) {
+                if (inner->terminal) return false;
+                inner->terminal = new Leaf(key);
+                break;
+            }
+            Node** child = find_child(inner, key[depth]);
+            if (!child) {
+                *ref = add_child(inner, key[depth], new Leaf(key));
+                break;
+            }
+            ref = child;
+            depth++;
+        }
+        size_++;
+        return true;
+    }
+
+    // Returns false if the key was not present.
+    bool erase(const string& key) {
+        if (!erase(&root_, key, 0)) return false;
+        size_--;
+        return true;
+    }
+
+    // Calls fn(key) in ascending key order for keys that start with prefix and sort after
+    // `bound` (or equal to it when inclusive), until fn returns false.
+    template <typename Fn>
+    void scan(const string& prefix, const string& bound, bool inclusive, Fn&& fn) const {
+        string path;
+        bool done = false;
+        scan(root_, path, prefix, bound, inclusive, fn, done);
+    }
+
+private:
+    enum Type : uint8_t { kLeaf, kNode4, kNode16, kNode48, kNode256 };
+
+    struct Node {
+        explicit Node(Type t) : type(t) {}
+        Type type;
+    };
+
+    struct Leaf : Node {
+        explicit Leaf(const string& k) : Node(kLeaf), key(k) {}
+        string key;
+    };
+
+    struct Inner : Node {
+        explicit Inner(Type t) : Node(t) {}
+        string prefix;
+        Leaf* terminal = nullptr;
+        uint16_t count = 0;
+    };
+
+    // Node4 and Node16 keep their bytes sorted.
+    struct Node4 : Inner {
+        Node4() : Inner(kNode4) {}
+        uint8_t keys[4];
+        Node* children[4];
+    };
+
+    struct Node16 : Inner {
+        Node16() : Inner(kNode16) {}
+        uint8_t keys[16];
+        Node* children[16];
+    };
+
+    // slot[b] is 1 + the index of byte b's child, or 0.
+    struct Node48 : Inner {
+        Node48() : Inner(kNode48) { memset(slot, 0, sizeof(slot)); }
+        uint8_t slot[256];
+        Node* children[48];
+    };
+
+    struct Node256 : Inner {
+        Node256() : Inner(kNode256) { memset(children, 0, sizeof(children)); }
+        Node* children[256];
+    };
+
+    static void destroy(Node* node) {
+        if (!node) return;
+        if (node->type == kLeaf) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        delete inner->terminal;
+        for_each_child(inner, 0, [](uint8_t, Node* child) {
+            destroy(child);
+            return true;
+        });
+        free_inner(inner);
+    }
+
+    static void free_inner(Inner* inner) {
+        switch (inner->type) {
+            case kNode4: delete static_cast<Node4*>(inner); break;
+            case kNode16: delete static_cast<Node16*>(inner); break;
+            case kNode48: delete static_cast<Node48*>(inner); break;
+            default: delete static_cast<Node256*>(inner); break;
+        }
+    }
+
+    // Places a leaf under a fresh split node whose prefix ends at depth.
+    static void attach(Node4* split, Leaf* leaf, const string& key, size_t depth) {
+        if (depth == key.size()) {
+            split->terminal = leaf;
+        } else {
+            add_child(split, key[depth], leaf);
+        }
+    }
+
+    static Node** find_child(Inner* inner, uint8_t byte) {
+        switch (inner->type) {
+            case kNode4: {
+                Node4* n = static_cast<Node4*>(inner);
+                for (int i = 0; i < n->count; ++i) {
+                    if (n->keys[i] == byte) return &n->children[i];
+                }
+                return nullptr;
+            }
+            case kNode16: {
+                Node16* n = static_cast<Node16*>(inner);
+                uint8_t* end = n->keys + n->count;
+                uint8_t* it = lower_bound(n->keys, end, byte);
+                return it != end && *it == byte ? &n->children[it - n->keys] : nullptr;
+            }
+            case kNode48: {
+                Node48* n = static_cast<Node48*>(inner);
+                return n->slot[byte] ? &n->children[n->slot[byte] - 1] : nullptr;
+            }
+            default: {
+                Node256* n = static_cast<Node256*>(inner);
+                return n->children[byte] ? &n->children[byte] : nullptr;
+            }
+        }
+    }
+
+    template <typename Small>
+    static void insert_sorted(Small* n, uint8_t byte, Node* child) {
+        int pos = 0;
+        while (pos < n->count && n->keys[pos] < byte) ++pos;
+        memmove(n->keys + pos + 1, n->keys + pos, n->count - pos);
+        memmove(n->children + pos + 1, n->children + pos, (n->count - pos) * sizeof(Node*));
+        n->keys[pos] = byte;
+        n->children[pos] = child;
+        n->count++;
+    }
+
+    template <typename To>
+    static To* regrow(Inner* from) {
+        To* to = new To;
+        to->prefix = move(from->prefix);
+        to->terminal = from->terminal;
+        for_each_child(from, 0, [&](uint8_t byte, Node* child) {
+            add_child(to, byte, child);
+            return true;
+        });
+        free_inner(from);
+        return to;
+    }
+
+    // Adds a child, growing the node if it is full; returns the node now in its place.
+    static Inner* add_child(Inner* inner, uint8_t byte, Node* child) {
+        switch (inner->type) {
+            case kNode4: {
+                Node4* n = static_cast<Node4*>(inner);
+                if (n->count < 4) {
+                    insert_sorted(n, byte, child);
+                    return n;
+                }
+                return add_child(regrow<Node16>(n), byte, child);
+            }
+            case kNode16: {
+                Node16* n = static_cast<Node16*>(inner);
+                if (n->count < 16) {
+                    insert_sorted(n, byte, child);
+                    return n;
+                }
+                return add_child(regrow<Node48>(n), byte, child);
+            }
+            case kNode48: {
+                Node48* n = static_cast<Node48*>(inner);
+                if (n->count < 48) {
+                    n->children[n->count] = child;
+                    n->slot[byte] = ++n->count;
+                    return n;
+                }
+                return add_child(regrow<Node256>(n), byte, child);
+            }
+            default: {
+                Node256* n = static_cast<Node256*>(inner);
+                n->children[byte] = child;
+                n->count++;
+                return n;
+            }
+        }
+    }
+
+    // Removes a child, shrinking the node once it falls well below capacity; returns the
+    // node now in its place.
+    static Inner* remove_child(Inner* inner, uint8_t byte) {
+        switch (inner->type) {
+            case kNode4:
+            case kNode16: {
+                uint8_t* keys = inner->type == kNode4 ? static_cast<Node4*>(inner)->keys : static_cast<Node16*>(inner)->keys;
+                Node** children = inner->type == kNode4 ? static_cast<Node4*>(inner)->children
+                                                        : static_cast<Node16*>(inner)->children;
+                int pos = 0;
+                while (keys[pos] != byte) ++pos;
+                memmove(keys + pos, keys + pos + 1, inner->count - pos - 1);
+                memmove(children + pos, children + pos + 1, (inner->count - pos - 1) * sizeof(Node*));
+                inner->count--;
+                if (inner->type == kNode16 && inner->count <= 3) return regrow<Node4>(inner);
+                return inner;
+            }
+            case kNode48: {
+                Node48* n = static_cast<Node48*>(inner);
+                int pos = n->slot[byte] - 1;
+                n->slot[byte] = 0;
+                n->count--;
+                // Keep children dense: move the last one into the hole.
+                if (pos != n->count) {
+                    n->children[pos] = n->children[n->count];
+                    for (int b = 0; b < 256; ++b) {
+                        if (n->slot[b] == n->count + 1) {
+                            n->slot[b] = pos + 1;
+                            break;
+                        }
+                    }
+                }
+                if (n->count <= 12) return regrow<Node16>(n);
+                return n;
+            }
+            default: {
+                Node256* n = static_cast<Node256*>(inner);
+                n->children[byte] = nullptr;
+                n->count--;
+                if (n->count <= 37) return regrow<Node48>(n);
+                return n;
+            }
+        }
+    }
+
+    // Visits children in byte order starting at `from`, until fn returns false.
+    template <typename Fn>
+    static bool for_each_child(Inner* inner, int from, Fn&& fn) {
+        switch (inner->type) {
+            case kNode4:
+            case kNode16: {
+                uint8_t* keys = inner->type == kNode4 ? static_cast<Node4*>(inner)->keys : static_cast<Node16*>(inner)->keys;
+                Node** children = inner->type == kNode4 ? static_cast<Node4*>(inner)->children
+                                                        : static_cast<Node16*>(inner)->children;
+                for (int i = 0; i < inner->count; ++i) {
+                    if (keys[i] >= from && !fn(keys[i], children[i])) return false;
+                }
+                return true;
+            }
+            case kNode48: {
+                Node48* n = static_cast<Node48*>(inner);
+                for (int b = from; b < 256; ++b) {
+                    if (n->slot[b] && !fn((uint8_t)b, n->children[n->slot[b] - 1])) return false;
+                }
+                return true;
+            }
+            default: {
+                Node256* n = static_cast<Node256*>(inner);
+                for (int b = from; b < 256; ++b) {
+                    if (n->children[b] && !fn((uint8_t)b, n->children[b])) return false;
+                }
+                return true;
+            }
+        }
+    }
+
+    bool erase(Node** ref, const string& key, size_t depth) {
+        Node* node = *ref;
+        if (!node) return false;
+        if (node->type == kLeaf) {
+            if (static_cast<Leaf*>(node)->key != key) return false;
+            delete static_cast<Leaf*>(node);
+            *ref = nullptr;
+            return true;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        if (key.compare(depth, inner->prefix.size(), inner->prefix) != 0) return false;
+        depth += inner->prefix.size();
+        if (depth == key.size()) {
+            if (!inner->terminal) return false;
+            delete inner->terminal;
+            inner->terminal = nullptr;
+        } else {
+            Node** child = find_child(inner, key[depth]);
+            if (!child || !erase(child, key, depth + 1)) return false;
+            if (!*child) inner = remove_child(inner, key[depth]);
+        }
+        *ref = collapse(inner);
+        return true;
+    }
+
+    // Replaces an inner node that no longer branches: an empty one by its terminal leaf
+    // (or nothing), and a single-child one without a terminal by that child.
+    static Node* collapse(Inner* inner) {
+        if (inner->count == 0) {
+            Node* replacement = inner->terminal;
+            free_inner(inner);
+            return replacement;
+        }
+        if (inner->count > 1 || inner->terminal) return inner;
+
+        uint8_t byte = 0;
+        Node* only = nullptr;
+        for_each_child(inner, 0, [&](uint8_t b, Node* child) {
+            byte = b;
+            only = child;
+            return false;
+        });
+        if (only->type != kLeaf) {
+            Inner* child = static_cast<Inner*>(only);
+            child->prefix = inner->prefix + (char)byte + child->prefix;
+        }
+        free_inner(inner);
+        return only;
+    }
+
+    // Whether any key starting with path can match: path and prefix must agree where they
+    // overlap, and path must not already sort below the bound.
+    static bool reachable(const string& path, const string& prefix, const string& bound) {
+        size_t n = min(path.size(), prefix.size());
+        if (path.compare(0, n, prefix, 0, n) != 0) return false;
+        size_t m = min(path.size(), bound.size());
+        return path.compare(0, m, bound, 0, m) >= 0;
+    }
+
+    template <typename Fn>
+    static void scan(const Node* node, string& path, const string& prefix, const string& bound, bool inclusive,
+                     Fn& fn, bool& done) {
+        if (!node || done) return;
+        if (node->type == kLeaf) {
+            const string& key = static_cast<const Leaf*>(node)->key;
+            int cmp = key.compare(bound);
+            if (key.compare(0, prefix.size(), prefix) == 0 && (cmp > 0 || (inclusive && cmp == 0)) && !fn(key)) {
+                done = true;
+            }
+            return;
+        }
+
+        const Inner* inner = static_cast<const Inner*>(node);
+        size_t restore = path.size();
+        path += inner->prefix;
+        if (reachable(path, prefix, bound)) {
+            scan(inner->terminal, path, prefix, bound, inclusive, fn, done);
+            // While path is a prefix of the bound, children below the bound's next byte
+            // cannot match.
+            int from = path.size() < bound.size() && bound.compare(0, path.size(), path) == 0
+                           ? (uint8_t)bound[path.size()] : 0;
+            for_each_child(const_cast<Inner*>(inner), from, [&](uint8_t byte, Node* child) {
+                path.push_back(byte);
+                if (reachable(path, prefix, bound)) scan(child, path, prefix, bound, inclusive, fn, done);
+                path.pop_back();
+                return !done;
+            });
+        }
+        path.resize(restore);
+    }
+
+    Node* root_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "kv_cache.h"
+#include "storage_backend.h"
+
+// Streaming loader behind POST /admin/import. The body is parsed as it arrives and records
+// are routed by key hash to one of `workers` partitions. Each partition thread applies a
+// full chunk as one backend batch (one WAL entry, multi-row upserts) and then fills the
+// cache. A key always maps to the same partition, so its writes keep their order. Queues
+// are two chunks deep, so a slow backend pushes back on the client socket.
+//
+// Formats:
+//   ndjson   one {"key":"...","value":"..."} object per line
+//   binary   (key_len, value_len, key, value) records with 32-bit host-order lengths, the
+//            record layout of a cache snapshot section
+class BulkImport {
+public:
+    enum Format { Ndjson, Binary };
+
+    struct Options {
+        Format format = Ndjson;
+        size_t workers = 4;
+        size_t chunk_records = 1000;
+        size_t chunk_bytes = 4 << 20;
+        bool fill_cache = true;
+    };
+
+    BulkImport(shared_ptr<ShardedKVCache> cache, shared_ptr<StorageBackend> db, const Options& options)
+        : cache_(cache), db_(db), options_(options) {
+        for (size_t i = 0; i < max<size_t>(1, options_.workers); ++i) {
+            partitions_.push_back(make_unique<Partition>());
+            partitions_.back()->worker = thread(&BulkImport::apply_loop, this, partitions_.back().get());
+        }
+    }
+
+    ~BulkImport() {
+        stop();
+    }
+
+    // Consumes the next piece of the body. Returns false once the input is malformed or
+    // the backend has failed; the caller should stop sending.
+    bool feed(const char* data, size_t len) {
+        if (!error_.empty() || failed_) return false;
+        bytes_ += len;
+        pending_.append(data, len);
+        size_t consumed = options_.format == Ndjson ? parse_ndjson(false) : parse_binary();
+        pending_.erase(0, consumed);
+        return error_.empty() && !failed_;
+    }
+
+    // Parses what is left, flushes partial chunks and waits for every partition. Returns
+    // false if the input was malformed; rethrows the first backend exception.
+    bool finish() {
+        if (error_.empty()) {
+            if (options_.format == Ndjson) {
+                parse_ndjson(true);
+            } else if (!pending_.empty()) {
+                error_ = "truncated record at end of input";
+            }
+        }
+        for (auto& p : partitions_) submit(*p);
+        stop();
+        if (backend_error_) rethrow_exception(backend_error_);
+        return error_.empty();
+    }
+
+    // Appends one record in the given format; GET /admin/export writes with this, so a dump
+    // can be fed straight back in.
+    static void encode(Format format, const string& key, const string& value, string& out) {
+        if (format == Binary) {
+            uint32_t key_len = key.size(), value_len = value.size();
+            out.append((const char*)&key_len, 4);
+            out.append((const char*)&value_len, 4);
+            out += key;
+            out += value;
+        } else {
+            out += "{\"key\":\"";
+            out += json_escape(key);
+            out += "\",\"value\":\"";
+            out += json_escape(value);
+            out += "\"}\n";
+        }
+    }
+
+    const string& error() const { return error_; }
+    size_t records() const { return applied_.load(); }
+    size_t skipped() const { return skipped_; }
+    size_t chunks() const { return chunks_.load(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Partition {
+        mutex mtx;
+        condition_variable cv;
+        deque<vector<WriteOp>> queue;
+        bool done = false;
+        thread worker;
+        vector<WriteOp> building;
+        size_t building_bytes = 0;
+    };
+
+    static constexpr size_t kQueueDepth = 2;
+    static constexpr uint32_t kMaxKeyLen = 1 << 16;
+
+    // Returns the number of bytes of pending_ consumed. At end of input a final line
+    // without a trailing newline is parsed too. The unconsumed tail has no newline, so the
+    // next call resumes the search where this one stopped instead of rescanning the line.
+    size_t parse_ndjson(bool at_end) {
+        size_t pos = 0;
+        size_t from = scanned_;
+        while (error_.empty()) {
+            size_t nl = pending_.find('\n', from);
+            if (nl == string::npos && !(at_end && pos < pending_.size())) break;
+            size_t line_end = nl == string::npos ? pending_.size() : nl;
+            parse_json_line(pending_.data() + pos, pending_.data() + line_end);
+            pos = from = nl == string::npos ? pending_.size() : nl + 1;
+        }
+        scanned_ = pending_.size() - pos;
+        return pos;
+    }
+
+    void parse_json_line(const char* p, const char* end) {
+        line_++;
+        auto skip_ws = [&] { while (p < end && isspace((unsigned char)*p)) ++p; };
+        skip_ws();
+        if (p == end) return;
+        string key, value, name, field;
+        bool has_key = false, has_value = false;
+        if (*p++ != '{') return fail_line("expected an object");
+        skip_ws();
+        while (p < end && *p != '}') {
+            if (!json_read_string(p, end, name)) return fail_line("bad field name");
+            skip_ws();
+            if (p == end || *p++ != ':') return fail_line("expected ':'");
+            skip_ws();
+            if (!json_read_string(p, end, field)) return fail_line("field values must be strings");
+            if (name == "key") {
+                key = move(field);
+                has_key = true;
+            } else if (name == "value") {
+                value = move(field);
+                has_value = true;
+            }
+            skip_ws();
+            if (p < end && *p == ',') {
+                ++p;
+                skip_ws();
+            }
+        }
+        if (p == end) return fail_line("unterminated object");
+        if (!has_key || !has_value) return fail_line("missing key or value");
+        if (key.size() > kMaxKeyLen) return fail_line("key too long");
+        if (value.size() > kMaxValueBytes) return fail_line("value too long");
+        add(move(key), move(value));
+    }
+
+    void fail_line(const char* what) {
+        error_ = "line " + to_string(line_) + ": " + what;
+    }
+
+    size_t parse_binary() {
+        size_t pos = 0;
+        while (pending_.size() - pos >= 8) {
+            uint32_t key_len, value_len;
+            memcpy(&key_len, pending_.data() + pos, 4);
+            memcpy(&value_len, pending_.data() + pos + 4, 4);
+            if (key_len > kMaxKeyLen) {
+                error_ = "record at byte " + to_string(bytes_ - pending_.size() + pos) + ": key length " + to_string(key_len);
+                break;
+            }
+            if (value_len > kMaxValueBytes) {
+                error_ = "record at byte " + to_string(bytes_ - pending_.size() + pos) + ": value length " + to_string(value_len);
+                break;
+            }
+            if (pending_.size() - pos - 8 < (uint64_t)key_len + value_len) break;
+            const char* p = pending_.data() + pos + 8;
+            add(string(p, key_len), string(p + key_len, value_len));
+            pos += 8 + (size_t)key_len + value_len;
+        }
+        return pos;
+    }
+
+    // An empty value reads back as a miss, so such records are counted and dropped.
+    void add(string key, string value) {
+        if (key.empty() || value.empty()) {
+            skipped_++;
+            return;
+        }
+        Partition& p = *partitions_[hash<string>{}(key) % partitions_.size()];
+        p.building_bytes += key.size() + value.size();
+        p.building.push_back({WriteOp::Put, move(key), move(value)});
+        if (p.building.size() >= options_.chunk_records || p.building_bytes >= options_.chunk_bytes) submit(p);
+    }
+
+    void submit(Partition& p) {
+        if (p.building.empty()) return;
+        {
+            unique_lock<mutex> lock(p.mtx);
+            p.cv.wait(lock, [&] { return p.queue.size() < kQueueDepth || failed_; });
+            p.queue.push_back(move(p.building));
+        }
+        p.cv.notify_all();
+        p.building.clear();
+        p.building_bytes = 0;
+    }
+
+    void apply_loop(Partition* p) {
+        while (true) {
+            vector<WriteOp> chunk;
+            {
+                unique_lock<mutex> lock(p->mtx);
+                p->cv.wait(lock, [&] { return p->done || !p->queue.empty(); });
+                if (p->queue.empty()) return;
+                chunk = move(p->queue.front());
+                p->queue.pop_front();
+            }
+            p->cv.notify_all();
+            if (failed_) continue;
+            try {
+                db_->batch(chunk);
+                if (options_.fill_cache) {
+                    for (auto& op : chunk) cache_->create(op.key, move(op.value));
+                }
+                applied_ += chunk.size();
+                chunks_++;
+            } catch (...) {
+                lock_guard<mutex> lock(error_mutex_);
+                if (!backend_error_) backend_error_ = current_exception();
+                failed_ = true;
+            }
+        }
+    }
+
+    void stop() {
+        for (auto& p : partitions_) {
+            {
+                lock_guard<mutex> lock(p->mtx);
+                p->done = true;
+            }
+            p->cv.notify_all();
+        }
+        for (auto& p : partitions_) {
+            if (p->worker.joinable()) p->worker.join();
+        }
+    }
+
+    shared_ptr<ShardedKVCache> cache_;
+    shared_ptr<StorageBackend> db_;
+    Options options_;
+    vector<unique_ptr<Partition>> partitions_;
+    string pending_;
+    size_t scanned_ = 0;   // leading bytes of pending_ known to hold no newline
+    string error_;
+    size_t line_ = 0;
+    size_t bytes_ = 0;
+    size_t skipped_ = 0;
+    atomic<size_t> applied_{0};
+    atomic<size_t> chunks_{0};
+    atomic<bool> failed_{false};
+    mutex error_mutex_;
+    exception_ptr backend_error_;
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "kv_cache.h"
+#include "storage_backend.h"
+
+// Writes point-in-time (per shard) copies of ShardedKVCache to disk in the background and
+// reloads them at startup so a restarted server comes back warm.
+//
+// A snapshot only reflects the backend as of when it was taken: this or another server may
+// have written since. load() therefore never overwrites a cached entry, and verify() checks
+// every cached entry against the backend afterwards, dropping those it disagrees with so the
+// next read fetches the backend's value.
+//
+// File layout: "KVSNAP02" | shard_count | pad | taken_at (unix ms) |
+// per-shard {offset, bytes, entries, crc32} | per-shard sections of
+// (key_len, value_len, key, value) records. The section table lets the loader mmap the
+// file and decode every shard on its own thread.
+class CacheSnapshotter {
+public:
+    CacheSnapshotter(shared_ptr<ShardedKVCache> cache, shared_ptr<StorageBackend> db, string path,
+                     chrono::seconds interval)
+        : cache_(cache), db_(db), path_(path), interval_(interval) {
+        snapshot_thread_ = thread(&CacheSnapshotter::run, this);
+    }
+
+    ~CacheSnapshotter() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stop_flag_ = true;
+        }
+        cv_.notify_one();
+        if (snapshot_thread_.joinable()) {
+            snapshot_thread_.join();
+        }
+        if (verify_thread_.joinable()) {
+            verify_thread_.join();
+        }
+    }
+
+    // Asks the background thread for a snapshot; returns false if one is already pending.
+    bool request() {
+        lock_guard<mutex> lock(mutex_);
+        if (requested_) return false;
+        requested_ = true;
+        cv_.notify_one();
+        return true;
+    }
+
+    // Loads the snapshot at path_ into the cache; returns the number of entries loaded.
+    size_t load() {
+        auto start = chrono::steady_clock::now();
+        int fd = open(path_.c_str(), O_RDONLY);
+        if (fd == -1) return 0;
+        uint64_t size = lseek(fd, 0, SEEK_END);
+        if (size < kHeaderSize) {
+            close(fd);
+            return 0;
+        }
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return 0;
+        const char* data = (const char*)map;
+
+        uint32_t shard_count = 0;
+        int64_t taken_at_ms = 0;
+        if (memcmp(data, kMagic, 8) == 0) {
+            memcpy(&shard_count, data + 8, 4);
+            memcpy(&taken_at_ms, data + 16, 8);
+        }
+        if (shard_count == 0 || kHeaderSize + (uint64_t)shard_count * kSectionSize > size) {
+            cerr << "[SNAPSHOT] Ignoring " << path_ << ": bad header" << endl;
+            munmap(map, size);
+            return 0;
+        }
+
+        atomic<size_t> next_section{0}, loaded{0};
+        auto load_sections = [&] {
+            for (size_t s = next_section++; s < shard_count; s = next_section++) {
+                Section sec;
+                memcpy(&sec, data + kHeaderSize + s * kSectionSize, kSectionSize);
+                if (sec.offset + sec.bytes > size || crc32(data + sec.offset, sec.bytes) != sec.crc) {
+                    cerr << "[SNAPSHOT] Skipping corrupt section " << s << endl;
+                    continue;
+                }
+                const char* p = data + sec.offset;
+                const char* end = p + sec.bytes;
+                while (end - p >= 8) {
+                    uint32_t key_len, value_len;
+                    memcpy(&key_len, p, 4);
+                    memcpy(&value_len, p + 4, 4);
+                    if ((uint64_t)(end - p - 8) < (uint64_t)key_len + value_len) break;
+                    if (cache_->create_if_absent(string(p + 8, key_len), string(p + 8 + key_len, value_len))) {
+                        loaded++;
+                    }
+                    p += 8 + key_len + value_len;
+                }
+            }
+        };
+
+        size_t workers = min<size_t>(shard_count, max(1u, thread::hardware_concurrency()));
+        vector<thread> loaders;
+        for (size_t i = 1; i < workers; ++i) loaders.emplace_back(load_sections);
+        load_sections();
+        for (auto& t : loaders) t.join();
+        munmap(map, size);
+
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        auto age_s = chrono::duration_cast<chrono::seconds>(
+            chrono::system_clock::now() - chrono::system_clock::time_point(chrono::milliseconds(taken_at_ms))).count();
+        cout << "[SNAPSHOT] Loaded " << loaded << " entries from " << path_ << " (taken " << age_s << " s ago) in "
+             << ms << " ms." << endl;
+        return loaded;
+    }
+
+    // Compares every cached entry with the backend, `parallelism` shards at a time, and drops
+    // the ones whose backend value differs or is gone, along with any batch the backend
+    // could not read. Dropping is safe against concurrent writes: at worst a fresh entry is
+    // dropped and refilled by the next read. Returns the number of entries dropped.
+    size_t verify(size_t parallelism, size_t batch_size = 500) {
+        auto start = chrono::steady_clock::now();
+        atomic<size_t> next_shard{0}, checked{0}, dropped{0};
+        auto worker = [&] {
+            vector<pair<string, string>> page;
+            vector<string> keys;
+            for (size_t idx = next_shard++; idx < cache_->shard_count(); idx = next_shard++) {
+                uint64_t cursor = 0;
+                do {
+                    page.clear();
+                    cursor = cache_->scan_shard_page(idx, cursor, batch_size, page);
+                    keys.clear();
+                    for (const auto& [key, value] : page) keys.push_back(key);
+                    unordered_map<string, string> current;
+                    try {
+                        for (auto& [key, value] : db_->read_batch(keys)) current.emplace(move(key), move(value));
+                    } catch (const exception& e) {
+                        cerr << "[SNAPSHOT] Verify batch failed, dropping it: " << e.what() << endl;
+                        current.clear();
+                    }
+                    for (const auto& [key, value] : page) {
+                        auto it = current.find(key);
+                        if (it == current.end() || it->second != value) {
+                            cache_->del(key);
+                            dropped++;
+                        }
+                    }
+                    checked += page.size();
+                } while (cursor != 0);
+            }
+        };
+        vector<thread> workers;
+        for (size_t i = 1; i < parallelism; ++i) workers.emplace_back(worker);
+        worker();
+        for (auto& t : workers) t.join();
+
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        cout << "[SNAPSHOT] Verified " << checked << " entries against the backend, dropped " << dropped
+             << " stale in " << ms << " ms." << endl;
+        return dropped;
+    }
+
+    void verify_async(size_t parallelism) {
+        verify_thread_ = thread([this, parallelism] { verify(parallelism); });
+    }
+
+    long long snapshots_written() const {
+        return snapshots_written_.load();
+    }
+
+private:
+    static constexpr const char* kMagic = "KVSNAP02";
+    static constexpr size_t kHeaderSize = 24;
+
+    struct Section {
+        uint64_t offset;
+        uint64_t bytes;
+        uint64_t entries;
+        uint64_t crc;
+    };
+    static constexpr size_t kSectionSize = sizeof(Section);
+
+    void run() {
+        auto next = chrono::steady_clock::now() + interval_;
+        unique_lock<mutex> lock(mutex_);
+        while (!stop_flag_) {
+            if (interval_.count() > 0) {
+                cv_.wait_until(lock, next, [this] { return stop_flag_ || requested_; });
+            } else {
+                cv_.wait(lock, [this] { return stop_flag_ || requested_; });
+            }
+            if (stop_flag_) break;
+
+            requested_ = false;
+            lock.unlock();
+            write_snapshot();
+            next = chrono::steady_clock::now() + interval_;
+            lock.lock();
+        }
+    }
+
+    bool write_snapshot() {
+        auto start = chrono::steady_clock::now();
+        int64_t taken_at_ms =
+            chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        string tmp_path = path_ + ".tmp";
+        int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            cerr << "[SNAPSHOT] Cannot create " << tmp_path << ": " << strerror(errno) << endl;
+            return false;
+        }
+
+        uint32_t shard_count = cache_->shard_count();
+        vector<Section> sections(shard_count);
+        uint64_t offset = kHeaderSize + shard_count * kSectionSize;
+        uint64_t total_entries = 0;
+        bool ok = true;
+        string buf;
+
+        for (uint32_t s = 0; s < shard_count && ok; ++s) {
+            Section& sec = sections[s];
+            sec = {offset, 0, 0, 0};
+            uint32_t crc = 0;
+            cache_->scan_shard(s, 1024, [&](vector<pair<string, string>>& batch) {
+                buf.clear();
+                for (const auto& [key, value] : batch) {
+                    uint32_t key_len = key.size(), value_len = value.size();
+                    buf.append((const char*)&key_len, 4);
+                    buf.append((const char*)&value_len, 4);
+                    buf += key;
+                    buf += value;
+                }
+                crc = crc32(buf.data(), buf.size(), crc);
+                ok = ok && pwrite(fd, buf.data(), buf.size(), offset) == (ssize_t)buf.size();
+                offset += buf.size();
+                sec.bytes += buf.size();
+                sec.entries += batch.size();
+            });
+            sec.crc = crc;
+            total_entries += sec.entries;
+        }
+
+        string header(kMagic, 8);
+        header.append((const char*)&shard_count, 4);
+        header.append(4, '\0');
+        header.append((const char*)&taken_at_ms, 8);
+        header.append((const char*)sections.data(), shard_count * kSectionSize);
+        ok = ok && pwrite(fd, header.data(), header.size(), 0) == (ssize_t)header.size();
+        ok = ok && fdatasync(fd) == 0;
+        close(fd);
+        if (!ok || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+            cerr << "[SNAPSHOT] Failed to write " << path_ << endl;
+            unlink(tmp_path.c_str());
+            return false;
+        }
+
+        snapshots_written_++;
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        cout << "[SNAPSHOT] Wrote " << total_entries << " entries (" << offset << " bytes) to "
+             << path_ << " in " << ms << " ms." << endl;
+        return true;
+    }
+
+    shared_ptr<ShardedKVCache> cache_;
+    shared_ptr<StorageBackend> db_;
+    string path_;
+    chrono::seconds interval_;
+
+    mutex mutex_;
+    condition_variable cv_;
+    bool requested_ = false;
+    bool stop_flag_ = false;
+    thread snapshot_thread_;
+    thread verify_thread_;
+    atomic<long long> snapshots_written_{0};
+};
+
+// Periodically persists the keys with the most cache hits (hottest first) and, on
+// startup, prefetches them from the backend with batched multi-key reads spread across
+// several threads, so a restart does not turn into a miss storm against MySQL.
+//
+// Manifest layout: "KVHOT001" | key_count | (key_len, key) records.
+class HotSetManager {
+public:
+    HotSetManager(shared_ptr<ShardedKVCache> cache, shared_ptr<StorageBackend> db, string path,
+                  size_t top_n, chrono::seconds interval)
+        : cache_(cache), db_(db), path_(path), top_n_(top_n), interval_(interval) {
+        manifest_thread_ = thread(&HotSetManager::run, this);
+    }
+
+    ~HotSetManager() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stop_flag_ = true;
+        }
+        cv_.notify_one();
+        if (manifest_thread_.joinable()) {
+            manifest_thread_.join();
+        }
+        if (prefetch_thread_.joinable()) {
+            prefetch_thread_.join();
+        }
+    }
+
+    // Loads the manifest keys into the cache with `parallelism` concurrent batched reads.
+    // Keys are handed out hottest first, so the head of the hot set is warm soonest.
+    size_t prefetch(size_t parallelism, size_t batch_size = 500) {
+        auto start = chrono::steady_clock::now();
+        vector<string> keys = read_manifest();
+        if (keys.empty()) return 0;
+
+        atomic<size_t> next{0}, loaded{0};
+        auto worker = [&] {
+            for (size_t begin = next.fetch_add(batch_size); begin < keys.size(); begin = next.fetch_add(batch_size)) {
+                vector<string> batch(keys.begin() + begin, keys.begin() + min(begin + batch_size, keys.size()));
+                // With --warmup=async writes are live: like a GET miss, a value is only cached
+                // if its shard saw no write or delete since before the backend read.
+                unordered_map<string, uint64_t> epochs;
+                for (const auto& key : batch) epochs.emplace(key, cache_->epoch(cache_->shard_of(key)));
+                try {
+                    for (auto& [key, value] : db_->read_batch(batch)) {
+                        auto it = epochs.find(key);
+                        if (it != epochs.end() && cache_->fill(key, value, it->second)) loaded++;
+                    }
+                } catch (const exception& e) {
+                    cerr << "[HOTSET] Prefetch batch failed: " << e.what() << endl;
+                }
+            }
+        };
+        vector<thread> workers;
+        for (size_t i = 1; i < parallelism; ++i) workers.emplace_back(worker);
+        worker();
+        for (auto& t : workers) t.join();
+
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        cout << "[HOTSET] Prefetched " << loaded << " of " << keys.size() << " hot keys in " << ms << " ms." << endl;
+        return loaded;
+    }
+
+    void prefetch_async(size_t parallelism) {
+        prefetch_thread_ = thread([this, parallelism] { prefetch(parallelism); });
+    }
+
+private:
+    static constexpr const char* kMagic = "KVHOT001";
+
+    void run() {
+        unique_lock<mutex> lock(mutex_);
+        while (!stop_flag_) {
+            cv_.wait_for(lock, interval_, [this] { return stop_flag_; });
+            if (stop_flag_) break;
+            lock.unlock();
+            write_manifest();
+            lock.lock();
+        }
+    }
+
+    bool write_manifest() {
+        auto hot = cache_->hottest(top_n_, true);
+        if (hot.empty()) return false;
+
+        string buf(kMagic, 8);
+        uint32_t count = hot.size();
+        buf.append((const char*)&count, 4);
+        for (const auto& [key, hits] : hot) {
+            uint32_t key_len = key.size();
+            buf.append((const char*)&key_len, 4);
+            buf += key;
+        }
+
+        string tmp_path = path_ + ".tmp";
+        int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd != -1 && write(fd, buf.data(), buf.size()) == (ssize_t)buf.size() && fdatasync(fd) == 0;
+        if (fd != -1) close(fd);
+        if (!ok || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+            cerr << "[HOTSET] Failed to write " << path_ << endl;
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    vector<string> read_manifest() {
+        vector<string> keys;
+        ifstream in(path_, ios::binary);
+        string buf((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (buf.size() < 12 || buf.compare(0, 8, kMagic) != 0) return keys;
+
+        uint32_t count;
+        memcpy(&count, buf.data() + 8, 4);
+        size_t pos = 12;
+        while (keys.size() < count && buf.size() - pos >= 4) {
+            uint32_t key_len;
+            memcpy(&key_len, buf.data() + pos, 4);
+            if (buf.size() - pos - 4 < key_len) break;
+            keys.emplace_back(buf, pos + 4, key_len);
+            pos += 4 + key_len;
+        }
+        return keys;
+    }
+
+    shared_ptr<ShardedKVCache> cache_;
+    shared_ptr<StorageBackend> db_;
+    string path_;
+    size_t top_n_;
+    chrono::seconds interval_;
+
+    mutex mutex_;
+    condition_variable cv_;
+    bool stop_flag_ = false;
+    thread manifest_thread_;
+    thread prefetch_thread_;
+};
@@ -0,0 +1,544 @@
+#include "kv_common.h"
+#include "metrics.h"
+#include "kv_cache.h"
+#include "progressive_hash_map.h"
+#include "storage_backend.h"
+#include "bulk_import.h"
+#include "stub_backend.h"
+#include "log_store.h"
+#include "cache_persistence.h"
+#include "near_cache.h"
+#include "hot_keys.h"
+
+#include <csignal>
+#include <random>
+#include <set>
+
+// In-process checks of component contracts that the benchmarks do not exercise: failure
+// paths and on-disk formats. No MySQL, no HTTP, no test framework; exits non-zero on the
+// first failed check:
+//   g++ -std=c++17 component_tests.cpp -o component_tests -lpthread && ./component_tests
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond << endl; \
+            exit(1);                                                                  \
+        }                                                                             \
+    } while (0)
+
+namespace {
+
+// Rejects every batch, the way DBManager::batch does after a failed transaction.
+class FailingBackend : public StorageBackend {
+public:
+    void create(const string&, const string&) override {}
+    string read(const string&) override { return ""; }
+    void del(const string&) override {}
+    void batch(const vector<WriteOp>&) override {
+        batches++;
+        throw runtime_error("simulated write failure");
+    }
+
+    atomic<int> batches{0};
+};
+
+// Serves fixed values, and runs during_read after reading them but before returning, the
+// way a write that commits while a batched read is in flight would.
+class RacingBackend : public StorageBackend {
+public:
+    void create(const string& key, const string& value) override { data[key] = value; }
+    string read(const string& key) override { return data.count(key) ? data[key] : ""; }
+    void del(const string& key) override { data.erase(key); }
+    void batch(const vector<WriteOp>&) override {}
+    vector<pair<string, string>> read_batch(const vector<string>& keys) override {
+        auto found = StorageBackend::read_batch(keys);
+        if (during_read) during_read();
+        return found;
+    }
+
+    map<string, string> data;
+    function<void()> during_read;
+};
+
+}  // namespace
+
+// A chunk the backend rejects must not be counted or cached, and finish() must surface
+// the error instead of reporting success.
+static void import_surfaces_backend_failure() {
+    auto cache = make_shared<ShardedKVCache>(4);
+    auto db = make_shared<FailingBackend>();
+    BulkImport::Options options;
+    options.workers = 2;
+    options.chunk_records = 10;
+    BulkImport import(cache, db, options);
+
+    string body;
+    for (int i = 0; i < 100; ++i) body += "{\"key\":\"k" + to_string(i) + "\",\"value\":\"v\"}\n";
+    import.feed(body.data(), body.size());
+
+    bool threw = false;
+    try {
+        import.finish();
+    } catch (const runtime_error& e) {
+        threw = string(e.what()) == "simulated write failure";
+    }
+    CHECK(threw);
+    CHECK(db->batches > 0);
+    CHECK(import.records() == 0);
+    for (int i = 0; i < 100; ++i) CHECK(cache->read("k" + to_string(i)).empty());
+}
+
+// Lines split across any number of feeds parse the same as whole ones, and a binary record
+// announcing a value longer than kMaxValueBytes stops the import before it is buffered.
+static void import_handles_split_lines_and_oversized_values() {
+    auto cache = make_shared<ShardedKVCache>(4);
+    auto db = make_shared<RacingBackend>();
+    {
+        BulkImport import(cache, db, BulkImport::Options());
+        string body;
+        for (int i = 0; i < 50; ++i) body += "{\"key\":\"k" + to_string(i) + "\",\"value\":\"v\\n" + to_string(i) + "\"}\n";
+        body += "{\"key\":\"last\",\"value\":\"x\"}";
+        for (size_t i = 0; i < body.size(); i += 3) CHECK(import.feed(body.data() + i, min<size_t>(3, body.size() - i)));
+        CHECK(import.finish());
+        CHECK(import.records() == 51);
+        CHECK(cache->read("k7") == "v\n7");
+        CHECK(cache->read("last") == "x");
+    }
+
+    BulkImport::Options options;
+    options.format = BulkImport::Binary;
+    BulkImport import(cache, db, options);
+    string body;
+    BulkImport::encode(BulkImport::Binary, "ok", "v", body);
+    uint32_t key_len = 3, value_len = kMaxValueBytes + 1;
+    body.append((const char*)&key_len, 4);
+    body.append((const char*)&value_len, 4);
+    CHECK(!import.feed(body.data(), body.size()));
+    CHECK(!import.finish());
+    CHECK(import.error() == "record at byte 11: value length " + to_string(value_len));
+    CHECK(import.records() == 1);
+}
+
+// A miss fill that raced with a write or delete of its shard is dropped, even when the
+// deleted key was never cached.
+static void fill_drops_values_that_raced_a_write() {
+    ShardedKVCache cache(4);
+    uint64_t epoch = cache.epoch(cache.shard_of("k"));
+    cache.del("k");
+    CHECK(!cache.fill("k", "stale", epoch));
+    CHECK(cache.read("k").empty());
+
+    epoch = cache.epoch(cache.shard_of("k"));
+    CHECK(cache.fill("k", "v1", epoch));
+    CHECK(cache.read("k") == "v1");
+
+    epoch = cache.epoch(cache.shard_of("k"));
+    cache.create("k", "v2");
+    CHECK(!cache.fill("k", "v1", epoch));
+    CHECK(cache.read("k") == "v2");
+}
+
+// Hot-set prefetch drops values whose shard was written while the batch was being read,
+// and still caches keys of untouched shards.
+static void prefetch_drops_values_that_raced_a_write() {
+    auto cache = make_shared<ShardedKVCache>(64);
+    auto db = make_shared<RacingBackend>();
+    string quiet;
+    for (int i = 0; quiet.empty(); ++i) {
+        string key = "q" + to_string(i);
+        size_t shard = cache->shard_of(key);
+        if (shard != cache->shard_of("deleted") && shard != cache->shard_of("rewritten")) quiet = key;
+    }
+    for (const string& key : {string("deleted"), string("rewritten"), quiet}) db->data[key] = "old";
+    db->during_read = [&] {
+        db->during_read = nullptr;
+        db->del("deleted");
+        cache->del("deleted");
+        db->create("rewritten", "new");
+        cache->create("rewritten", "new");
+    };
+
+    string path = (filesystem::temp_directory_path() / "kv_component_tests.hotset").string();
+    {
+        string manifest("KVHOT001", 8);
+        uint32_t count = 3;
+        manifest.append((const char*)&count, 4);
+        for (const string& key : {string("deleted"), string("rewritten"), quiet}) {
+            uint32_t key_len = key.size();
+            manifest.append((const char*)&key_len, 4);
+            manifest += key;
+        }
+        ofstream(path, ios::binary) << manifest;
+    }
+    HotSetManager hotset(cache, db, path, 10, chrono::seconds(3600));
+    CHECK(hotset.prefetch(1) == 1);
+    CHECK(cache->read("deleted").empty());
+    CHECK(cache->read("rewritten") == "new");
+    CHECK(cache->read(quiet) == "old");
+    filesystem::remove(path);
+}
+
+// Hits served by the near-cache are credited to the shared entry, so the key it serves
+// most still ranks first for the hot-set manifest.
+static void near_cache_hits_count_for_hottest() {
+    auto cache = make_shared<ShardedKVCache>(4);
+    cache->create("hot", "v");
+    cache->create("warm", "v");
+    for (int i = 0; i < 20; ++i) cache->read("warm");
+
+    NearCache::Options options;
+    options.admit = [](const string&) { return true; };
+    NearCache near(cache, options);
+    for (int i = 0; i < 200; ++i) CHECK(near.get("hot", [&] { return cache->read("hot"); }) == "v");
+
+    auto top = cache->hottest(2, false);
+    CHECK(top.size() == 2);
+    CHECK(top[0].first == "hot");
+    CHECK(top[0].second >= 129);
+}
+
+// The index agrees with std::set through random inserts and erases: every prefix scan
+// returns the same keys in the same order, starting from any bound.
+static void art_index_matches_set() {
+    mt19937 gen(42);
+    auto random_key = [&] {
+        string key(1 + gen() % 6, 'a');
+        // Mostly a narrow alphabet so prefixes are shared, sometimes any byte so nodes grow
+        // to the 256-way layout.
+        for (char& c : key) c = gen() % 8 ? "abcd"[gen() % 4] : (char)(gen() % 256);
+        return key;
+    };
+    ArtIndex index;
+    set<string> expected;
+    for (int op = 0; op < 50000; ++op) {
+        string key = random_key();
+        if (gen() % 3) {
+            CHECK(index.insert(key) == expected.insert(key).second);
+        } else {
+            CHECK(index.erase(key) == (expected.erase(key) == 1));
+        }
+        CHECK(index.size() == expected.size());
+        if (op % 100 != 0) continue;
+
+        string prefix = random_key().substr(0, gen() % 3);
+        string bound = gen() % 2 ? random_key() : "";
+        bool inclusive = gen() % 2;
+        size_t limit = 1 + gen() % 50;
+        vector<string> got, want;
+        index.scan(prefix, bound, inclusive, [&](const string& k) {
+            got.push_back(k);
+            return got.size() < limit;
+        });
+        for (const string& k : expected) {
+            if (want.size() == limit) break;
+            if (k.compare(0, prefix.size(), prefix) == 0 && (inclusive ? k >= bound : k > bound)) want.push_back(k);
+        }
+        CHECK(got == want);
+    }
+}
+
+// Paging through scan_prefix with next_cursor visits every matching key once and in order.
+// With keys deleted and re-created while pages are built, a page can lose all of its keys
+// and still has to hand back a cursor, or the walk would stop early and miss the rest.
+static void scan_prefix_pages_survive_deletes() {
+    ShardedKVCache cache(8, true);
+    mt19937 gen(7);
+    set<string> expected;
+    for (int i = 0; i < 5000; ++i) {
+        string key = (gen() % 2 ? "p" : "q") + to_string(gen() % 3000);
+        if (gen() % 4) {
+            cache.create(key, "v" + key);
+            expected.insert(key);
+        } else {
+            cache.del(key);
+            expected.erase(key);
+        }
+    }
+    for (size_t limit : {1, 7, 100}) {
+        vector<string> got;
+        auto page = cache.scan_prefix("p", "", true, limit);
+        while (true) {
+            for (const auto& [key, value] : page.items) {
+                CHECK(value == "v" + key);
+                got.push_back(key);
+            }
+            if (!page.more) break;
+            page = cache.scan_prefix("p", page.next_cursor, false, limit);
+        }
+        vector<string> want;
+        for (const string& key : expected) {
+            if (key[0] == 'p') want.push_back(key);
+        }
+        CHECK(got == want);
+    }
+
+    // Odd keys churn underneath the walk; the even ones stay put and must all be seen.
+    ShardedKVCache churned(4, true);
+    for (int i = 0; i < 400; ++i) churned.create("c" + to_string(1000 + i), "v");
+    atomic<bool> stop{false};
+    thread churn([&] {
+        while (!stop) {
+            for (int i = 1; i < 400; i += 2) churned.del("c" + to_string(1000 + i));
+            for (int i = 1; i < 400; i += 2) churned.create("c" + to_string(1000 + i), "v");
+        }
+    });
+    // The window between listing a page and copying its values is short, so walks repeat
+    // until a few pages have come back empty.
+    size_t empty_pages = 0;
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(30);
+    while (empty_pages < 3 && chrono::steady_clock::now() < deadline) {
+        vector<string> stable;
+        string cursor;
+        bool first = true;
+        while (true) {
+            auto page = churned.scan_prefix("c", cursor, first, 1);
+            first = false;
+            if (page.items.empty() && page.more) empty_pages++;
+            for (const auto& item : page.items) {
+                if ((stoi(item.first.substr(1)) - 1000) % 2 == 0) stable.push_back(item.first);
+            }
+            if (!page.more) break;
+            CHECK(page.next_cursor > cursor);
+            cursor = page.next_cursor;
+        }
+        CHECK(stable.size() == 200);
+        CHECK(is_sorted(stable.begin(), stable.end()));
+    }
+    stop = true;
+    churn.join();
+    CHECK(empty_pages > 0);
+}
+
+// Reading the report applies due decay, so counts fall once traffic stops instead of
+// waiting for the next flush of samples.
+static void hot_keys_decay_without_traffic() {
+    HotKeyTracker::Options options;
+    options.sample_every = 1;
+    options.window = chrono::seconds(1);
+    HotKeyTracker tracker(make_shared<ShardedKVCache>(4), options);
+    for (int i = 0; i < 64; ++i) tracker.record("k", false);
+    CHECK(tracker.estimate("k") == 64);
+    CHECK(tracker.top(1).at(0).key == "k");
+
+    this_thread::sleep_for(chrono::milliseconds(2100));
+    tracker.top(1);
+    CHECK(tracker.estimate("k") == 16);
+}
+
+// The scan cursor survives resizes and bucket migration between calls: entries present for
+// the whole walk are seen exactly once while the map grows several times underneath.
+static void hash_map_scan_survives_growth() {
+    ProgressiveHashMap<int> map;
+    for (int i = 0; i < 1000; ++i) map.try_emplace("old" + to_string(i), i);
+    size_t resizes = map.resizes();
+
+    unordered_map<string, int> seen;
+    uint64_t cursor = 0;
+    int added = 0;
+    do {
+        cursor = map.scan(cursor, 7, [&](const string& key, int&) { seen[key]++; });
+        for (int i = 0; i < 50; ++i, ++added) map.try_emplace("new" + to_string(added), added);
+        map.erase("new" + to_string(added / 2));
+    } while (cursor != 0);
+
+    CHECK(map.resizes() > resizes);
+    for (int i = 0; i < 1000; ++i) CHECK(seen["old" + to_string(i)] == 1);
+    for (const auto& [key, count] : seen) CHECK(count == 1);
+}
+
+// Binary keys and values, including newlines, colons and NULs, come back from the WAL
+// byte for byte, and a torn tail record is dropped rather than misparsed.
+static void wal_round_trips_binary_records() {
+    string path = (filesystem::temp_directory_path() / "kv_component_tests_wal.log").string();
+    filesystem::remove(path);
+    string key = "bin:key\n"s;
+    string value = "line1\nline2:\0\xff\r\n"s;
+    {
+        auto wal = make_shared<BoundedAsyncWALLogger>(path);
+        StubBackend backend(wal, LatencyModel());
+        backend.create(key, value);
+        backend.batch({{WriteOp::Put, "a", "x\ny"}, {WriteOp::Delete, "b", ""}, {WriteOp::Put, "c:d", ""}});
+    }
+
+    vector<pair<string, string>> records;
+    auto collect = [&](const string& k, const string& v) { records.emplace_back(k, v); };
+    CHECK(BoundedAsyncWALLogger::replay(path, collect) == 3);
+    CHECK(records[0] == make_pair(key, value));
+    CHECK(records[1] == make_pair(string("a"), string("x\ny")));
+    CHECK(records[2] == make_pair(string("c:d"), string()));
+
+    filesystem::resize_file(path, filesystem::file_size(path) - 1);
+    records.clear();
+    CHECK(BoundedAsyncWALLogger::replay(path, collect) == 2);
+    filesystem::remove(path);
+}
+
+// A rejected latency spec leaves the previous model in place, whichever field it fails on.
+static void latency_model_rejects_specs_whole() {
+    LatencyModel model;
+    CHECK(model.parse("fixed:100"));
+    for (string bad : {"fixed:abc", "fixed:100:x", "lognormal:abc:1", "lognormal:100", "replay:/nonexistent", "slow"}) {
+        CHECK(!model.parse(bad));
+        CHECK(model.spec() == "fixed:100");
+        CHECK(model.sample() == chrono::microseconds(100));
+    }
+}
+
+static uint64_t stat_value(StorageBackend& backend, const string& name) {
+    stringstream out;
+    backend.append_stats(out);
+    for (string line; getline(out, line);) {
+        if (line.compare(0, name.size() + 1, name + " ") == 0) return stoull(line.substr(name.size() + 1));
+    }
+    return UINT64_MAX;
+}
+
+// Garbage is exactly the file bytes not referenced by the keydir, also after overwriting
+// records that a merge moved, and recovery skips *.data files it did not write.
+static void log_store_counts_garbage_exactly() {
+    auto dir = filesystem::temp_directory_path() / "kv_component_tests_logstore";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    ofstream(dir / "notes.data") << "not a segment";
+
+    LogStoreConfig config;
+    config.data_dir = dir.string();
+    config.sync_writes = false;
+    config.max_file_bytes = 64;   // a file per record, so there is something to merge
+    config.merge_min_bytes = 0;
+    config.merge_garbage_ratio = 0.1;
+
+    map<string, string> live;
+    auto record_bytes = [](const string& key, const string& value) { return 13 + key.size() + value.size(); };
+    auto check = [&](LogStructuredStore& store) {
+        uint64_t total = 0, live_bytes = 0;
+        for (const auto& entry : filesystem::directory_iterator(dir)) {
+            if (entry.path().filename() != "notes.data") total += entry.file_size();
+        }
+        for (const auto& [key, value] : live) live_bytes += record_bytes(key, value);
+        CHECK(stat_value(store, "logstore_bytes") == total);
+        CHECK(stat_value(store, "logstore_garbage_bytes") == total - live_bytes);
+    };
+    {
+        LogStructuredStore store(config);
+        for (int i = 0; i < 8; ++i) store.create("k" + to_string(i), live["k" + to_string(i)] = "v" + to_string(i));
+        store.create("k0", live["k0"] = "rewritten");
+        store.del("k1");
+        live.erase("k1");
+        check(store);
+
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(15);
+        while (stat_value(store, "logstore_merges_total") == 0 && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+        CHECK(stat_value(store, "logstore_merges_total") > 0);
+        check(store);
+
+        for (int i = 2; i < 8; ++i) store.create("k" + to_string(i), live["k" + to_string(i)] = "again" + to_string(i));
+        check(store);
+    }
+    LogStructuredStore reopened(config);
+    check(reopened);
+    for (const auto& [key, value] : live) CHECK(reopened.read(key) == value);
+    filesystem::remove_all(dir);
+}
+
+// A write that fails partway leaves no torn bytes behind: the next record lands right after
+// the last good one, and all of them are there after reopening. RLIMIT_FSIZE makes write()
+// stop partway through the large value.
+static void log_store_drops_torn_writes() {
+    auto dir = filesystem::temp_directory_path() / "kv_component_tests_torn";
+    filesystem::remove_all(dir);
+    LogStoreConfig config;
+    config.data_dir = dir.string();
+    config.sync_writes = false;
+    {
+        LogStructuredStore store(config);
+        store.create("a", "1");
+        uint64_t before = stat_value(store, "logstore_bytes");
+
+        rlimit saved;
+        getrlimit(RLIMIT_FSIZE, &saved);
+        rlimit limited = saved;
+        limited.rlim_cur = before + 100;
+        signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &limited);
+        bool threw = false;
+        try {
+            store.create("big", string(1000, 'x'));
+        } catch (const runtime_error&) {
+            threw = true;
+        }
+        setrlimit(RLIMIT_FSIZE, &saved);
+        signal(SIGXFSZ, SIG_DFL);
+        CHECK(threw);
+        CHECK(stat_value(store, "logstore_bytes") == before);
+
+        store.create("b", "2");
+        uint64_t total = 0;
+        for (const auto& entry : filesystem::directory_iterator(dir)) total += entry.file_size();
+        CHECK(stat_value(store, "logstore_bytes") == total);
+        CHECK(stat_value(store, "logstore_garbage_bytes") == 0);
+    }
+    LogStructuredStore reopened(config);
+    CHECK(reopened.read("a") == "1");
+    CHECK(reopened.read("b") == "2");
+    CHECK(reopened.read("big").empty());
+    filesystem::remove_all(dir);
+}
+
+// Snapshot entries never replace live cache entries, and verify() drops the ones the
+// backend has overwritten or deleted since the snapshot was taken.
+static void snapshot_load_defers_to_backend() {
+    string path = (filesystem::temp_directory_path() / "kv_component_tests.snap").string();
+    filesystem::remove(path);
+    auto db = make_shared<StubBackend>(make_shared<BoundedAsyncWALLogger>(path + ".wal"), LatencyModel());
+    {
+        auto cache = make_shared<ShardedKVCache>(4);
+        for (string key : {"a", "b", "c", "d"}) cache->create(key, "old");
+        CacheSnapshotter snapshotter(cache, db, path, chrono::seconds(0));
+        CHECK(snapshotter.request());
+        while (snapshotter.snapshots_written() == 0) this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    db->create("a", "new");
+    db->create("c", "old");
+    db->create("d", "old");
+
+    auto cache = make_shared<ShardedKVCache>(4);
+    cache->create("d", "live");
+    CacheSnapshotter snapshotter(cache, db, path, chrono::seconds(0));
+    CHECK(snapshotter.load() == 3);
+    CHECK(cache->read("d") == "live");
+    CHECK(snapshotter.verify(2) == 3);
+    CHECK(cache->read("a").empty());
+    CHECK(cache->read("b").empty());
+    CHECK(cache->read("c") == "old");
+    CHECK(cache->read("d").empty());
+    filesystem::remove(path);
+    filesystem::remove(path + ".wal");
+}
+
+int main() {
+    const pair<const char*, void (*)()> tests[] = {
+        {"import_surfaces_backend_failure", import_surfaces_backend_failure},
+        {"import_handles_split_lines_and_oversized_values", import_handles_split_lines_and_oversized_values},
+        {"fill_drops_values_that_raced_a_write", fill_drops_values_that_raced_a_write},
+        {"prefetch_drops_values_that_raced_a_write", prefetch_drops_values_that_raced_a_write},
+        {"near_cache_hits_count_for_hottest", near_cache_hits_count_for_hottest},
+        {"art_index_matches_set", art_index_matches_set},
+        {"scan_prefix_pages_survive_deletes", scan_prefix_pages_survive_deletes},
+        {"hot_keys_decay_without_traffic", hot_keys_decay_without_traffic},
+        {"hash_map_scan_survives_growth", hash_map_scan_survives_growth},
+        {"wal_round_trips_binary_records", wal_round_trips_binary_records},
+        {"latency_model_rejects_specs_whole", latency_model_rejects_specs_whole},
+        {"log_store_counts_garbage_exactly", log_store_counts_garbage_exactly},
+        {"log_store_drops_torn_writes", log_store_drops_torn_writes},
+        {"snapshot_load_defers_to_backend", snapshot_load_defers_to_backend},
+    };
+    for (const auto& [name, fn] : tests) {
+        fn();
+        cout << "ok   " << name << endl;
+    }
+    return 0;
+}
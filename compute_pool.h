@@ -0,0 +1,120 @@
+#pragma once
+
+#include "kv_common.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <sched.h>
+
+// Dedicated, optionally core-pinned threads for CPU-bound per-value work, so large
+// transforms run on their own cores instead of competing with the httplib I/O workers.
+// The queue is bounded: when it is full the caller runs the job itself, which keeps
+// latency bounded and pushes back on the I/O side instead of queueing without limit.
+class ComputePool {
+public:
+    ComputePool(size_t threads, const vector<int>& cores, size_t queue_capacity = 1024)
+        : capacity_(queue_capacity) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back(&ComputePool::worker, this);
+            if (!cores.empty()) pin(workers_.back(), cores[i % cores.size()]);
+        }
+        cout << "[COMPUTE] " << threads << " threads"
+             << (cores.empty() ? string() : ", pinned to " + to_string(cores.size()) + " cores")
+             << ", queue " << capacity_ << endl;
+    }
+
+    ~ComputePool() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    // Runs fn on a pool thread and waits for it to finish.
+    void run(const function<void()>& fn) {
+        Job job;
+        job.fn = &fn;
+        job.queued_at = chrono::steady_clock::now();
+        {
+            unique_lock<mutex> lock(mutex_);
+            if (queue_.size() >= capacity_) {
+                lock.unlock();
+                inline_runs_.inc();
+                fn();
+                return;
+            }
+            queue_.push_back(&job);
+        }
+        offloaded_.inc();
+        cv_.notify_one();
+
+        unique_lock<mutex> lock(job.mtx);
+        job.cv.wait(lock, [&] { return job.done; });
+        if (job.error) rethrow_exception(job.error);
+    }
+
+    void append_stats(ostream& out) {
+        size_t depth;
+        {
+            lock_guard<mutex> lock(mutex_);
+            depth = queue_.size();
+        }
+        out << "# TYPE kv_compute_offloaded_total counter\n"
+            << "kv_compute_offloaded_total " << offloaded_.value() << "\n"
+            << "# TYPE kv_compute_inline_total counter\n"
+            << "kv_compute_inline_total " << inline_runs_.value() << "\n"
+            << "# TYPE kv_compute_queue_depth gauge\n"
+            << "kv_compute_queue_depth " << depth << "\n";
+    }
+
+private:
+    struct Job {
+        const function<void()>* fn;
+        chrono::steady_clock::time_point queued_at;
+        mutex mtx;
+        condition_variable cv;
+        bool done = false;
+        exception_ptr error;
+    };
+
+    static void pin(thread& t, int core) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        if (pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) != 0) {
+            cerr << "[COMPUTE] Could not pin worker to core " << core << endl;
+        }
+    }
+
+    void worker() {
+        while (true) {
+            Job* job;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) return;
+                job = queue_.front();
+                queue_.pop_front();
+            }
+            stage_metrics().compute_queue_wait.record(chrono::steady_clock::now() - job->queued_at);
+            try {
+                (*job->fn)();
+            } catch (...) {
+                job->error = current_exception();
+            }
+            lock_guard<mutex> lock(job->mtx);
+            job->done = true;
+            job->cv.notify_one();
+        }
+    }
+
+    size_t capacity_;
+    mutex mutex_;
+    condition_variable cv_;
+    deque<Job*> queue_;
+    bool stop_ = false;
+    vector<thread> workers_;
+    Counter offloaded_;
+    Counter inline_runs_;
+};
@@ -0,0 +1,769 @@
+#pragma once
+
+#include "storage_backend.h"
+#include "profiled_mutex.h"
+#include "wal.h"
+
+class PoolTimeoutError : public runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
+struct DBConfig {
+    string primary_url = "tcp://127.0.0.1:3306";
+    vector<string> replica_urls;
+    string user = "kv_server_user";
+    string password = "MyProjectPassword123!";
+    string schema = "kv_store";
+    int pool_min = 20;
+    int pool_max = 64;
+    int max_replica_lag_s = 5;
+};
+
+// -DKV_WITHOUT_MYSQL builds without the MySQL connector: only the types above remain and
+// the server offers the log and stub backends.
+#ifndef KV_WITHOUT_MYSQL
+
+#include "cppconn/driver.h"
+#include "cppconn/exception.h"
+#include "cppconn/prepared_statement.h"
+#include "cppconn/resultset.h"
+#include "cppconn/statement.h"
+
+class ConnectionPool {
+public:
+    struct Stats {
+        int size, idle, in_use, waiting, min_size, max_size;
+        long long acquires, timeouts, opened, broken;
+        double avg_wait_us, max_wait_us, utilization;
+    };
+
+    ConnectionPool(string url, string user, string pass, string schema, int min_size, int max_size,
+                   chrono::milliseconds acquire_timeout = chrono::milliseconds(2000))
+        : url_(url), user_(user), pass_(pass), schema_(schema),
+          min_size_(min_size), max_size_(max(min_size, max_size)), acquire_timeout_(acquire_timeout) {
+        pool_mutex_.set_name("pool[" + url_ + "]");
+
+        driver_ = get_driver_instance();
+
+        // Connect in parallel so startup costs one handshake, not min_size of them.
+        vector<shared_ptr<sql::Connection>> fresh(min_size_);
+        vector<thread> connectors;
+        for (int i = 0; i < min_size_; ++i) {
+            connectors.emplace_back([this, &fresh, i] {
+                driver_->threadInit();
+                fresh[i] = connect();
+                driver_->threadEnd();
+            });
+        }
+        for (auto& t : connectors) t.join();
+
+        auto now = chrono::steady_clock::now();
+        for (auto& con : fresh) {
+            if (con) pool_.push_back({con, now});
+        }
+        total_ = pool_.size();
+        cout << "[POOL] Initialized with " << pool_.size() << " connections (min "
+             << min_size_ << ", max " << max_size_ << ")." << endl;
+
+        maintenance_thread_ = thread(&ConnectionPool::maintain, this);
+    }
+
+    ~ConnectionPool() {
+        {
+            lock_guard<ProfiledMutex> lock(pool_mutex_);
+            stop_flag_ = true;
+        }
+        maintenance_cv_.notify_one();
+        pool_cv_.notify_all();
+        if (maintenance_thread_.joinable()) {
+            maintenance_thread_.join();
+        }
+    }
+
+    // Throws PoolTimeoutError if no healthy connection frees up within acquire_timeout_.
+    shared_ptr<sql::Connection> getConnection() {
+        ScopedTimer timer(stage_metrics().pool_wait);
+        auto start = chrono::steady_clock::now();
+        auto deadline = start + acquire_timeout_;
+
+        while (true) {
+            unique_lock<ProfiledMutex> lock(pool_mutex_);
+            if (pool_.empty()) {
+                if (total_ + pending_ < max_size_) {
+                    maintenance_cv_.notify_one();
+                }
+                waiting_++;
+                bool ready = pool_cv_.wait_until(lock, deadline, [this] { return !pool_.empty() || stop_flag_; });
+                waiting_--;
+                if (!ready || pool_.empty()) {
+                    timeouts_++;
+                    throw PoolTimeoutError("no database connection available within " +
+                                           to_string(acquire_timeout_.count()) + " ms");
+                }
+            }
+
+            IdleConnection entry = pool_.front();
+            pool_.pop_front();
+            in_use_++;
+            peak_in_use_ = max(peak_in_use_, in_use_);
+            lock.unlock();
+
+            // Connections idle long enough for MySQL to have dropped them get pinged first.
+            auto now = chrono::steady_clock::now();
+            if (now - entry.idle_since > validate_after_idle_ && !isAlive(entry.con)) {
+                discard();
+                if (chrono::steady_clock::now() >= deadline) {
+                    timeouts_++;
+                    throw PoolTimeoutError("no healthy database connection available");
+                }
+                continue;
+            }
+
+            long long wait_ns = chrono::duration_cast<chrono::nanoseconds>(now - start).count();
+            recordWait(wait_ns);
+            acquires_++;
+            acquired_at() = now;
+            KV_PROBE2(pool__acquire, wait_ns, url_.c_str());
+            return entry.con;
+        }
+    }
+
+    // Pass broken = true when the connection failed with a connection-level error;
+    // it is dropped and the maintenance thread reconnects a replacement.
+    void releaseConnection(shared_ptr<sql::Connection> con, bool broken = false) {
+        if (KV_PROBE_ENABLED(pool__release)) {
+            KV_PROBE3(pool__release,
+                      chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - acquired_at()).count(),
+                      url_.c_str(), broken);
+        }
+        if (broken) {
+            discard();
+            return;
+        }
+        unique_lock<ProfiledMutex> lock(pool_mutex_);
+        in_use_--;
+        pool_.push_back({con, chrono::steady_clock::now()});
+        lock.unlock();
+        pool_cv_.notify_one();
+    }
+
+    Stats stats() {
+        lock_guard<ProfiledMutex> lock(pool_mutex_);
+        Stats s;
+        s.size = total_;
+        s.idle = pool_.size();
+        s.in_use = in_use_;
+        s.waiting = waiting_;
+        s.min_size = min_size_;
+        s.max_size = max_size_;
+        s.acquires = acquires_.load();
+        s.timeouts = timeouts_.load();
+        s.opened = opened_.load();
+        s.broken = broken_.load();
+        s.avg_wait_us = s.acquires > 0 ? wait_ns_total_.load() / 1000.0 / s.acquires : 0.0;
+        s.max_wait_us = wait_ns_max_.load() / 1000.0;
+        s.utilization = total_ > 0 ? (double)in_use_ / total_ : 0.0;
+        return s;
+    }
+
+    // MySQL client errors that mean the session itself is gone, not just the statement.
+    static bool isConnectionError(const sql::SQLException& e) {
+        int code = e.getErrorCode();
+        return code == 2002 || code == 2003 || code == 2006 || code == 2013 || code == 2055 || code == 4031;
+    }
+
+private:
+    struct IdleConnection {
+        shared_ptr<sql::Connection> con;
+        chrono::steady_clock::time_point idle_since;
+    };
+
+    // Callers hold one connection at a time, so the checkout time can live per thread.
+    static chrono::steady_clock::time_point& acquired_at() {
+        static thread_local chrono::steady_clock::time_point t;
+        return t;
+    }
+
+    shared_ptr<sql::Connection> connect() {
+        try {
+            shared_ptr<sql::Connection> con(driver_->connect(url_, user_, pass_));
+            con->setSchema(schema_);
+            return con;
+        } catch (sql::SQLException &e) {
+            cerr << "[POOL] Error connecting to " << url_ << ": " << e.what() << endl;
+            return nullptr;
+        }
+    }
+
+    bool isAlive(const shared_ptr<sql::Connection>& con) {
+        try {
+            return !con->isClosed() && con->isValid();
+        } catch (sql::SQLException &e) {
+            return false;
+        }
+    }
+
+    void discard() {
+        {
+            lock_guard<ProfiledMutex> lock(pool_mutex_);
+            in_use_--;
+            total_--;
+        }
+        broken_++;
+        maintenance_cv_.notify_one();
+    }
+
+    void recordWait(long long ns) {
+        wait_ns_total_ += ns;
+        window_wait_ns_ += ns;
+        long long prev = wait_ns_max_.load();
+        while (ns > prev && !wait_ns_max_.compare_exchange_weak(prev, ns)) {}
+    }
+
+    // Keeps the pool between min_size_ and max_size_: replaces dropped connections
+    // (with backoff while MySQL is down), grows when callers wait and shrinks when idle.
+    void maintain() {
+        driver_->threadInit();
+        const auto tick = chrono::seconds(1);
+        const long long grow_wait_ns = 1000000;
+        auto backoff = chrono::milliseconds(100);
+        auto retry_at = chrono::steady_clock::now();
+        long long last_acquires = acquires_.load();
+
+        unique_lock<ProfiledMutex> lock(pool_mutex_);
+        while (!stop_flag_) {
+            maintenance_cv_.wait_for(lock, tick);
+            if (stop_flag_) break;
+
+            long long acquires = acquires_.load();
+            long long window_acquires = acquires - last_acquires;
+            long long window_wait = window_wait_ns_.exchange(0);
+            last_acquires = acquires;
+            double avg_wait = window_acquires > 0 ? (double)window_wait / window_acquires : 0.0;
+
+            int wanted = max(min_size_ - total_, 0);
+            if (total_ < max_size_ && (waiting_ > 0 || avg_wait > grow_wait_ns)) {
+                wanted = max(wanted, min(max(total_ / 4, 1), max_size_ - total_));
+            } else if (wanted == 0 && total_ > min_size_ && peak_in_use_ * 2 < total_ && !pool_.empty()) {
+                pool_.pop_back();
+                total_--;
+            }
+            peak_in_use_ = in_use_;
+            if (wanted == 0 || chrono::steady_clock::now() < retry_at) continue;
+
+            pending_ += wanted;
+            lock.unlock();
+            vector<shared_ptr<sql::Connection>> fresh;
+            for (int i = 0; i < wanted; ++i) {
+                auto con = connect();
+                if (!con) break;
+                fresh.push_back(con);
+            }
+            lock.lock();
+            pending_ -= wanted;
+
+            if (fresh.empty()) {
+                retry_at = chrono::steady_clock::now() + backoff;
+                backoff = min(backoff * 2, chrono::milliseconds(5000));
+                continue;
+            }
+            backoff = chrono::milliseconds(100);
+            auto now = chrono::steady_clock::now();
+            for (auto& con : fresh) {
+                pool_.push_back({con, now});
+            }
+            total_ += fresh.size();
+            opened_ += fresh.size();
+            pool_cv_.notify_all();
+        }
+        lock.unlock();
+        driver_->threadEnd();
+    }
+
+    string url_, user_, pass_, schema_;
+    int min_size_, max_size_;
+    chrono::milliseconds acquire_timeout_;
+    chrono::seconds validate_after_idle_{30};
+    sql::Driver* driver_;
+
+    list<IdleConnection> pool_;
+    ProfiledMutex pool_mutex_;
+    condition_variable_any pool_cv_;
+    condition_variable_any maintenance_cv_;
+    int total_ = 0;
+    int pending_ = 0;
+    int in_use_ = 0;
+    int peak_in_use_ = 0;
+    int waiting_ = 0;
+    bool stop_flag_ = false;
+    thread maintenance_thread_;
+
+    atomic<long long> acquires_{0};
+    atomic<long long> timeouts_{0};
+    atomic<long long> opened_{0};
+    atomic<long long> broken_{0};
+    atomic<long long> wait_ns_total_{0};
+    atomic<long long> wait_ns_max_{0};
+    atomic<long long> window_wait_ns_{0};
+};
+
+// Writes always go to the primary. Cache-miss reads go to the healthy replica with the
+// fewest outstanding queries and fall back to the primary when replicas lag or fail.
+// A key written or deleted through this manager is read from the primary for the next
+// max_replica_lag_s + kFenceSlackS seconds: a replica that is behind by up to the allowed
+// lag, or that fell behind since the last health check, may still hold the old row.
+class DBManager : public StorageBackend {
+public:
+    DBManager(shared_ptr<BoundedAsyncWALLogger> logger, const DBConfig& config = DBConfig())
+        : logger_(logger), max_replica_lag_s_(config.max_replica_lag_s),
+          fence_window_(chrono::seconds(config.max_replica_lag_s + kFenceSlackS)) {
+        primary_ = make_unique<ConnectionPool>(
+            config.primary_url, config.user, config.password, config.schema, config.pool_min, config.pool_max
+        );
+        for (const auto& url : config.replica_urls) {
+            auto replica = make_unique<Replica>();
+            replica->url = url;
+            replica->pool = make_unique<ConnectionPool>(
+                url, config.user, config.password, config.schema, config.pool_min, config.pool_max
+            );
+            replicas_.push_back(move(replica));
+        }
+        if (!replicas_.empty()) {
+            health_thread_ = thread(&DBManager::monitor_replicas, this);
+        }
+    }
+
+    ~DBManager() {
+        {
+            lock_guard<mutex> lock(health_mutex_);
+            stop_flag_ = true;
+        }
+        health_cv_.notify_one();
+        if (health_thread_.joinable()) {
+            health_thread_.join();
+        }
+    }
+
+    void create(const string& key, const string& value) override {
+       
+        string wal_record;
+        BoundedAsyncWALLogger::append_record(wal_record, key, value);
+        logger_->log(move(wal_record));
+        auto con = primary_->getConnection();
+        bool broken = false;
+        try {
+            unique_ptr<sql::PreparedStatement> pstmt;
+            pstmt.reset(con->prepareStatement(
+                "INSERT INTO kv_pairs (id, value) VALUES (?, ?) ON DUPLICATE KEY UPDATE value = ?"
+            ));
+            pstmt->setString(1, key);
+            pstmt->setString(2, value);
+            pstmt->setString(3, value);
+            ScopedTimer timer(stage_metrics().db_execute);
+            pstmt->execute();
+        } catch (sql::SQLException &e) {
+            cerr << "DB Error: " << e.what() << endl;
+            broken = ConnectionPool::isConnectionError(e);
+        }
+        primary_->releaseConnection(con, broken);
+        fence(key);
+    }
+
+    string read(const string& key) override {
+        bool ok = false;
+        if (Replica* replica = fenced(key) ? nullptr : pick_replica()) {
+            replica->outstanding++;
+            string result;
+            try {
+                result = read_from(*replica->pool, key, ok);
+            } catch (const PoolTimeoutError&) {}
+            replica->outstanding--;
+            if (ok) return result;
+
+            // The health monitor re-admits the replica once it answers again.
+            replica->healthy = false;
+            replica_fallbacks_++;
+        }
+        return read_from(*primary_, key, ok);
+    }
+
+    vector<pair<string, string>> read_batch(const vector<string>& keys) override {
+        bool ok = false;
+        bool any_fenced = any_of(keys.begin(), keys.end(), [this](const string& key) { return fenced(key); });
+        if (Replica* replica = any_fenced ? nullptr : pick_replica()) {
+            replica->outstanding++;
+            vector<pair<string, string>> found;
+            try {
+                found = read_batch_from(*replica->pool, keys, ok);
+            } catch (const PoolTimeoutError&) {}
+            replica->outstanding--;
+            if (ok) return found;
+
+            replica->healthy = false;
+            replica_fallbacks_++;
+        }
+        return read_batch_from(*primary_, keys, ok);
+    }
+
+    void del(const string& key) override {
+        auto con = primary_->getConnection();
+        bool broken = false;
+        try {
+            unique_ptr<sql::PreparedStatement> pstmt;
+            pstmt.reset(con->prepareStatement("DELETE FROM kv_pairs WHERE id = ?"));
+            pstmt->setString(1, key);
+            ScopedTimer timer(stage_metrics().db_execute);
+            pstmt->execute();
+        } catch (sql::SQLException &e) {
+            broken = ConnectionPool::isConnectionError(e);
+        }
+        primary_->releaseConnection(con, broken);
+        fence(key);
+    }
+
+    // Runs of consecutive puts go out as multi-row upserts of up to kMaxRowsPerInsert rows,
+    // and the WAL gets the whole batch as one entry, so a chunk costs one write and fsync.
+    // A failed batch is rolled back and the SQL error rethrown.
+    void batch(const vector<WriteOp>& ops) override {
+        string wal_record;
+        for (const auto& op : ops) {
+            if (op.type == WriteOp::Put) BoundedAsyncWALLogger::append_record(wal_record, op.key, op.value);
+        }
+        if (!wal_record.empty()) logger_->log(move(wal_record));
+        auto con = primary_->getConnection();
+        bool broken = false;
+        try {
+            con->setAutoCommit(false);
+            map<size_t, unique_ptr<sql::PreparedStatement>> upserts;
+            unique_ptr<sql::PreparedStatement> remove(con->prepareStatement("DELETE FROM kv_pairs WHERE id = ?"));
+            ScopedTimer timer(stage_metrics().db_execute);
+            for (size_t i = 0; i < ops.size();) {
+                if (ops[i].type == WriteOp::Delete) {
+                    remove->setString(1, ops[i].key);
+                    remove->execute();
+                    ++i;
+                    continue;
+                }
+                size_t rows = 0;
+                while (i + rows < ops.size() && ops[i + rows].type == WriteOp::Put && rows < kMaxRowsPerInsert) ++rows;
+                auto& upsert = upserts[rows];
+                if (!upsert) upsert.reset(con->prepareStatement(multi_row_upsert(rows)));
+                for (size_t r = 0; r < rows; ++r) {
+                    upsert->setString(2 * r + 1, ops[i + r].key);
+                    upsert->setString(2 * r + 2, ops[i + r].value);
+                }
+                upsert->execute();
+                i += rows;
+            }
+            con->commit();
+            con->setAutoCommit(true);
+        } catch (sql::SQLException &e) {
+            cerr << "DB Error: " << e.what() << endl;
+            broken = ConnectionPool::isConnectionError(e);
+            if (!broken) {
+                try {
+                    con->rollback();
+                    con->setAutoCommit(true);
+                } catch (sql::SQLException &) {
+                    broken = true;
+                }
+            }
+            primary_->releaseConnection(con, broken);
+            throw;
+        }
+        primary_->releaseConnection(con, broken);
+        for (const auto& op : ops) fence(op.key);
+    }
+
+    // Keyset pagination in id order on the primary, one connection per page so a slow
+    // consumer never pins a pooled connection. The table's collation is case-insensitive, so
+    // matching and ordering use utf8mb4_bin: otherwise "User1" would match prefix "user" and
+    // the cursor order would not be byte order.
+    bool scan(const string& prefix, size_t batch_size,
+              const function<bool(vector<pair<string, string>>&)>& fn) override {
+        string pattern;
+        for (char c : prefix) {
+            if (c == '%' || c == '_' || c == '\\') pattern += '\\';
+            pattern += c;
+        }
+        pattern += '%';
+        string cursor;
+        bool first = true;
+        while (true) {
+            vector<pair<string, string>> batch;
+            auto con = primary_->getConnection();
+            bool broken = false;
+            try {
+                unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(
+                    first ? "SELECT id, value FROM kv_pairs WHERE id COLLATE utf8mb4_bin LIKE ? "
+                            "ORDER BY id COLLATE utf8mb4_bin LIMIT ?"
+                          : "SELECT id, value FROM kv_pairs WHERE id COLLATE utf8mb4_bin LIKE ? "
+                            "AND id COLLATE utf8mb4_bin > ? ORDER BY id COLLATE utf8mb4_bin LIMIT ?"));
+                int param = 1;
+                pstmt->setString(param++, pattern);
+                if (!first) pstmt->setString(param++, cursor);
+                pstmt->setInt(param, (int)batch_size);
+                unique_ptr<sql::ResultSet> res;
+                {
+                    ScopedTimer timer(stage_metrics().db_execute);
+                    res.reset(pstmt->executeQuery());
+                }
+                while (res->next()) batch.emplace_back(res->getString(1), res->getString(2));
+            } catch (sql::SQLException &e) {
+                cerr << "DB Error: " << e.what() << endl;
+                broken = ConnectionPool::isConnectionError(e);
+                primary_->releaseConnection(con, broken);
+                throw;
+            }
+            primary_->releaseConnection(con, broken);
+
+            bool last_page = batch.size() < batch_size;
+            if (!batch.empty()) cursor = batch.back().first;
+            first = false;
+            if (!batch.empty() && !fn(batch)) return true;
+            if (last_page) return true;
+        }
+    }
+
+    void append_stats(ostream& out) override {
+        vector<pair<string, ConnectionPool::Stats>> pools;
+        pools.emplace_back("primary", primary_->stats());
+        for (size_t i = 0; i < replicas_.size(); ++i) {
+            pools.emplace_back("replica" + to_string(i), replicas_[i]->pool->stats());
+        }
+        for (const auto& [name, s] : pools) {
+            string label = "{pool=\"" + name + "\"} ";
+            out << "pool_size" << label << s.size << "\n"
+                << "pool_idle" << label << s.idle << "\n"
+                << "pool_in_use" << label << s.in_use << "\n"
+                << "pool_waiting" << label << s.waiting << "\n"
+                << "pool_min_size" << label << s.min_size << "\n"
+                << "pool_max_size" << label << s.max_size << "\n"
+                << "pool_utilization" << label << s.utilization << "\n"
+                << "pool_acquires_total" << label << s.acquires << "\n"
+                << "pool_timeouts_total" << label << s.timeouts << "\n"
+                << "pool_connections_opened_total" << label << s.opened << "\n"
+                << "pool_connections_broken_total" << label << s.broken << "\n"
+                << "pool_wait_avg_us" << label << s.avg_wait_us << "\n"
+                << "pool_wait_max_us" << label << s.max_wait_us << "\n";
+        }
+        out << "db_replica_fallbacks_total " << replica_fallbacks_.load() << "\n";
+    }
+
+private:
+    static constexpr size_t kMaxRowsPerInsert = 500;
+
+    static string multi_row_upsert(size_t rows) {
+        string sql = "INSERT INTO kv_pairs (id, value) VALUES (?, ?)";
+        for (size_t r = 1; r < rows; ++r) sql += ", (?, ?)";
+        return sql + " ON DUPLICATE KEY UPDATE value = VALUES(value)";
+    }
+
+    struct Replica {
+        string url;
+        unique_ptr<ConnectionPool> pool;
+        atomic<int> outstanding{0};
+        atomic<bool> healthy{true};
+        string lag_error;   // last health check failure, owned by the monitor thread
+    };
+
+    struct FenceShard {
+        mutex mtx;
+        unordered_map<string, chrono::steady_clock::time_point> until;
+    };
+
+    static constexpr int kFenceSlackS = 2;   // health check interval + lag granularity
+    static constexpr size_t kFenceShards = 16;
+
+    FenceShard& fence_shard(const string& key) {
+        return fences_[hash<string>{}(key) % kFenceShards];
+    }
+
+    void fence(const string& key) {
+        if (replicas_.empty()) return;
+        auto until = chrono::steady_clock::now() + fence_window_;
+        FenceShard& shard = fence_shard(key);
+        lock_guard<mutex> lock(shard.mtx);
+        shard.until[key] = until;
+    }
+
+    bool fenced(const string& key) {
+        if (replicas_.empty()) return false;
+        FenceShard& shard = fence_shard(key);
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.until.find(key);
+        return it != shard.until.end() && it->second > chrono::steady_clock::now();
+    }
+
+    void prune_fences() {
+        auto now = chrono::steady_clock::now();
+        for (auto& shard : fences_) {
+            lock_guard<mutex> lock(shard.mtx);
+            for (auto it = shard.until.begin(); it != shard.until.end();) {
+                if (it->second <= now) it = shard.until.erase(it);
+                else ++it;
+            }
+        }
+    }
+
+    Replica* pick_replica() {
+        size_t n = replicas_.size();
+        if (n == 0) return nullptr;
+
+        size_t start = next_replica_++;
+        Replica* best = nullptr;
+        for (size_t i = 0; i < n; ++i) {
+            Replica* r = replicas_[(start + i) % n].get();
+            if (r->healthy && (!best || r->outstanding < best->outstanding)) {
+                best = r;
+            }
+        }
+        return best;
+    }
+
+    string read_from(ConnectionPool& pool, const string& key, bool& ok) {
+        auto con = pool.getConnection();
+        bool broken = false;
+        string result = "";
+        ok = false;
+        try {
+            unique_ptr<sql::PreparedStatement> pstmt;
+            unique_ptr<sql::ResultSet> res;
+            pstmt.reset(con->prepareStatement("SELECT value FROM kv_pairs WHERE id = ?"));
+            pstmt->setString(1, key);
+            {
+                ScopedTimer timer(stage_metrics().db_execute);
+                res.reset(pstmt->executeQuery());
+            }
+
+            if (res->next()) {
+                result = res->getString("value");
+            }
+            ok = true;
+        } catch (sql::SQLException &e) {
+            broken = ConnectionPool::isConnectionError(e);
+        }
+        pool.releaseConnection(con, broken);
+        return result;
+    }
+
+    vector<pair<string, string>> read_batch_from(ConnectionPool& pool, const vector<string>& keys, bool& ok) {
+        vector<pair<string, string>> found;
+        ok = keys.empty();
+        if (keys.empty()) return found;
+
+        string query = "SELECT id, value FROM kv_pairs WHERE id IN (?";
+        for (size_t i = 1; i < keys.size(); ++i) query += ",?";
+        query += ")";
+
+        auto con = pool.getConnection();
+        bool broken = false;
+        try {
+            unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(query));
+            for (size_t i = 0; i < keys.size(); ++i) {
+                pstmt->setString(i + 1, keys[i]);
+            }
+            unique_ptr<sql::ResultSet> res;
+            {
+                ScopedTimer timer(stage_metrics().db_execute);
+                res.reset(pstmt->executeQuery());
+            }
+            while (res->next()) {
+                found.emplace_back(res->getString(1), res->getString(2));
+            }
+            ok = true;
+        } catch (sql::SQLException &e) {
+            cerr << "DB Error: " << e.what() << endl;
+            broken = ConnectionPool::isConnectionError(e);
+        }
+        pool.releaseConnection(con, broken);
+        return found;
+    }
+
+    // Returns replication lag in seconds, 0 for a server that is not replicating,
+    // or -1 if the replica is unreachable, its replication threads are stopped or the
+    // status query fails. A failure is logged when it first occurs, not on every check.
+    long long replica_lag(Replica& replica) {
+        ConnectionPool& pool = *replica.pool;
+        shared_ptr<sql::Connection> con;
+        try {
+            con = pool.getConnection();
+        } catch (const PoolTimeoutError& e) {
+            report_lag_error(replica, e.what());
+            return -1;
+        }
+
+        long long lag = -1;
+        bool broken = false;
+        try {
+            unique_ptr<sql::Statement> stmt(con->createStatement());
+            unique_ptr<sql::ResultSet> res;
+            string column = "Seconds_Behind_Source";
+            try {
+                res.reset(stmt->executeQuery("SHOW REPLICA STATUS"));
+            } catch (sql::SQLException &e) {
+                if (ConnectionPool::isConnectionError(e)) throw;
+                res.reset(stmt->executeQuery("SHOW SLAVE STATUS"));
+                column = "Seconds_Behind_Master";
+            }
+            if (!res->next()) {
+                lag = 0;
+            } else if (!res->isNull(column)) {
+                lag = res->getInt64(column);
+            } else {
+                report_lag_error(replica, "replication threads are not running");
+            }
+            if (lag >= 0) replica.lag_error.clear();
+        } catch (sql::SQLException &e) {
+            broken = ConnectionPool::isConnectionError(e);
+            string error = e.what();
+            // ER_SPECIFIC_ACCESS_DENIED_ERROR: the status query needs REPLICATION CLIENT.
+            if (e.getErrorCode() == 1227) error += " (grant REPLICATION CLIENT to the server's user, see reset_db.sql)";
+            report_lag_error(replica, error);
+        }
+        pool.releaseConnection(con, broken);
+        return lag;
+    }
+
+    void report_lag_error(Replica& replica, const string& error) {
+        if (error == replica.lag_error) return;
+        replica.lag_error = error;
+        cerr << "[DB] Replica " << replica.url << " health check failed: " << error << endl;
+    }
+
+    void monitor_replicas() {
+        unique_lock<mutex> lock(health_mutex_);
+        while (!stop_flag_) {
+            lock.unlock();
+            for (auto& replica : replicas_) {
+                long long lag = replica_lag(*replica);
+                bool healthy = lag >= 0 && lag <= max_replica_lag_s_;
+                if (healthy != replica->healthy) {
+                    cout << "[DB] Replica " << replica->url << (healthy ? " back in rotation" : " removed from rotation")
+                         << " (lag " << lag << " s)" << endl;
+                }
+                replica->healthy = healthy;
+            }
+            prune_fences();
+            lock.lock();
+            health_cv_.wait_for(lock, chrono::seconds(1), [this] { return stop_flag_; });
+        }
+    }
+
+    unique_ptr<ConnectionPool> primary_;
+    vector<unique_ptr<Replica>> replicas_;
+    atomic<size_t> next_replica_{0};
+    atomic<long long> replica_fallbacks_{0};
+    shared_ptr<BoundedAsyncWALLogger> logger_;
+    long long max_replica_lag_s_;
+    chrono::steady_clock::duration fence_window_;
+    array<FenceShard, kFenceShards> fences_;
+
+    mutex health_mutex_;
+    condition_variable health_cv_;
+    bool stop_flag_ = false;
+    thread health_thread_;
+};
+
+#endif  // KV_WITHOUT_MYSQL
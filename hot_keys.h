@@ -0,0 +1,289 @@
+#pragma once
+
+#include "kv_cache.h"
+
+// Sampled access tracker behind GET /admin/hotkeys. Each thread keeps one access in
+// sample_every and buffers the samples. Buffers are applied kFlushSamples at a time under a
+// single mutex, so between flushes the request path does no shared writes. Samples feed:
+//   - a count-min sketch estimating the count of any key, readable without the lock
+//   - a SpaceSaving summary of the `capacity` most frequent keys, split by reads and writes
+//   - per-shard read and write counts
+// All counts are halved once per window, checked on every flush and on every top() or
+// shard_load(), so the report also cools down once traffic stops. For a key accessed at a
+// steady rate r, its count t seconds after a halving is r * (window + t) / sample_every,
+// and rates are derived from that.
+class HotKeyTracker {
+public:
+    struct Options {
+        uint32_t sample_every = 16;
+        size_t capacity = 128;
+        chrono::seconds window{10};
+        double hot_share = 0.001;   // is_hot(): at least this fraction of sampled traffic
+    };
+
+    struct KeyStat {
+        string key;
+        double rate;
+        double share;
+        double write_share;
+        uint64_t error;   // upper bound on the overcount, in samples
+    };
+
+    struct ShardStat {
+        double read_rate;
+        double write_rate;
+        double share;
+    };
+
+    HotKeyTracker(shared_ptr<ShardedKVCache> cache, const Options& options)
+        : cache_(cache), options_(options), id_(next_id()), sketch_(kDepth * kWidth),
+          shards_(cache->shard_count()), started_(chrono::steady_clock::now()), last_decay_(started_) {}
+
+    void record(const string& key, bool write) {
+        Local& local = local_state();
+        if (++local.tick % options_.sample_every != 0) return;
+        local.buffer.push_back({key, cache_->shard_of(key), write});
+        if (local.buffer.size() < kFlushSamples) return;
+
+        lock_guard<mutex> lock(mutex_);
+        decay_if_due(chrono::steady_clock::now());
+        for (auto& sample : local.buffer) apply(sample);
+        local.buffer.clear();
+    }
+
+    // Count-min estimate in (decayed) samples; never below the true count.
+    uint64_t estimate(const string& key) const {
+        return estimate_hash(mix(key));
+    }
+
+    // Admission hint for the near-cache and similar policies; lock-free.
+    bool is_hot(const string& key) const {
+        double total = total_.load(memory_order_relaxed);
+        return estimate(key) >= max<double>(kMinHotSamples, options_.hot_share * total);
+    }
+
+    vector<KeyStat> top(size_t n) {
+        lock_guard<mutex> lock(mutex_);
+        decay_if_due(chrono::steady_clock::now());
+        double scale = rate_scale();
+        double total = max<uint64_t>(1, total_.load(memory_order_relaxed));
+        vector<const Entry*> order;
+        for (const auto& entry : entries_) order.push_back(&entry);
+        sort(order.begin(), order.end(), [](const Entry* a, const Entry* b) { return a->count > b->count; });
+        vector<KeyStat> result;
+        for (size_t i = 0; i < min(n, order.size()); ++i) {
+            const Entry& e = *order[i];
+            result.push_back({e.key, e.count * scale, e.count / total,
+                              min(1.0, (double)e.writes / max<uint64_t>(1, e.count - e.error)), e.error});
+        }
+        return result;
+    }
+
+    vector<ShardStat> shard_load() {
+        lock_guard<mutex> lock(mutex_);
+        decay_if_due(chrono::steady_clock::now());
+        double scale = rate_scale();
+        double total = max<uint64_t>(1, total_.load(memory_order_relaxed));
+        vector<ShardStat> result;
+        for (const auto& s : shards_) {
+            result.push_back({s.reads * scale, s.writes * scale, (s.reads + s.writes) / total});
+        }
+        return result;
+    }
+
+    string to_json(size_t n) {
+        auto keys = top(n);
+        auto shards = shard_load();
+        double busiest = 0, sum = 0;
+        for (const auto& s : shards) {
+            busiest = max(busiest, s.read_rate + s.write_rate);
+            sum += s.read_rate + s.write_rate;
+        }
+        stringstream out;
+        out << "{\"sample_every\":" << options_.sample_every << ",\"window_s\":" << options_.window.count()
+            << ",\"samples_total\":" << samples_.value() << ",\"keys\":[";
+        for (size_t i = 0; i < keys.size(); ++i) {
+            const auto& k = keys[i];
+            out << (i ? "," : "") << "{\"key\":\"" << json_escape(k.key) << "\",\"rate_per_s\":" << k.rate
+                << ",\"share\":" << k.share << ",\"write_share\":" << k.write_share << ",\"error_samples\":" << k.error
+                << "}";
+        }
+        out << "],\"shards\":[";
+        for (size_t i = 0; i < shards.size(); ++i) {
+            const auto& s = shards[i];
+            out << (i ? "," : "") << "{\"shard\":" << i << ",\"read_rate_per_s\":" << s.read_rate
+                << ",\"write_rate_per_s\":" << s.write_rate << ",\"share\":" << s.share << "}";
+        }
+        out << "],\"shard_skew\":" << (sum > 0 ? busiest * shards.size() / sum : 0) << "}";
+        return out.str();
+    }
+
+    void append_stats(ostream& out) {
+        auto shards = shard_load();
+        double busiest = 0, sum = 0;
+        for (const auto& s : shards) {
+            busiest = max(busiest, s.read_rate + s.write_rate);
+            sum += s.read_rate + s.write_rate;
+        }
+        out << "# TYPE kv_hotkeys_samples_total counter\n"
+            << "kv_hotkeys_samples_total " << samples_.value() << "\n"
+            << "# TYPE kv_cache_shard_skew gauge\n"
+            << "kv_cache_shard_skew " << (sum > 0 ? busiest * shards.size() / sum : 0) << "\n";
+    }
+
+private:
+    struct Sample {
+        string key;
+        size_t shard;
+        bool write;
+    };
+
+    struct Local {
+        uint64_t owner = 0;
+        uint64_t tick = 0;
+        vector<Sample> buffer;
+    };
+
+    struct Entry {
+        string key;
+        uint64_t count;
+        uint64_t error;
+        uint64_t writes;
+    };
+
+    struct ShardCounts {
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+    };
+
+    static constexpr size_t kDepth = 4;
+    static constexpr size_t kWidth = 4096;
+    static constexpr size_t kFlushSamples = 8;
+    static constexpr uint64_t kMinHotSamples = 8;
+
+    static uint64_t next_id() {
+        static atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+    Local& local_state() {
+        static thread_local Local local;
+        if (local.owner != id_) {
+            local = Local();
+            local.owner = id_;
+        }
+        return local;
+    }
+
+    // The cache picks shards from hash % shard_count, so the raw hash's low bits are skewed
+    // within a shard; the sketch uses a mixed hash split into two halves (h1 + row * h2).
+    static uint64_t mix(const string& key) {
+        return hash<string>{}(key) * 0x9E3779B97F4A7C15ull;
+    }
+
+    uint64_t estimate_hash(uint64_t h) const {
+        uint32_t lowest = UINT32_MAX;
+        for (size_t row = 0; row < kDepth; ++row) {
+            lowest = min(lowest, sketch_[cell(h, row)].load(memory_order_relaxed));
+        }
+        return lowest;
+    }
+
+    static size_t cell(uint64_t h, size_t row) {
+        uint32_t h1 = h >> 32, h2 = (uint32_t)h | 1;
+        return row * kWidth + ((h1 + row * h2) & (kWidth - 1));
+    }
+
+    void apply(const Sample& sample) {
+        samples_.inc();
+        total_.store(total_.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        uint64_t h = mix(sample.key);
+        for (size_t row = 0; row < kDepth; ++row) {
+            auto& c = sketch_[cell(h, row)];
+            c.store(c.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        }
+        ShardCounts& shard = shards_[sample.shard];
+        (sample.write ? shard.writes : shard.reads)++;
+
+        auto it = index_.find(sample.key);
+        if (it != index_.end()) {
+            Entry& e = entries_[it->second];
+            e.count++;
+            e.writes += sample.write;
+            if (it->second == min_index_) min_valid_ = false;
+            return;
+        }
+        if (entries_.size() < options_.capacity) {
+            index_.emplace(sample.key, entries_.size());
+            entries_.push_back({sample.key, 1, 0, sample.write});
+            min_valid_ = false;
+            return;
+        }
+        // SpaceSaving: the new key takes over the smallest counter and inherits its count
+        // as error. Keys the sketch has not seen more often than that counter are not let in,
+        // so the long tail does not churn the summary.
+        if (!min_valid_) {
+            min_index_ = 0;
+            for (size_t i = 1; i < entries_.size(); ++i) {
+                if (entries_[i].count < entries_[min_index_].count) min_index_ = i;
+            }
+            min_valid_ = true;
+        }
+        Entry& e = entries_[min_index_];
+        if (estimate_hash(h) <= e.count) return;
+        index_.erase(e.key);
+        index_.emplace(sample.key, min_index_);
+        e = {sample.key, e.count + 1, e.count, sample.write};
+        min_valid_ = false;
+    }
+
+    void decay_if_due(chrono::steady_clock::time_point now) {
+        auto elapsed = now - last_decay_;
+        if (elapsed < options_.window) return;
+        int halvings = min<int64_t>(32, elapsed / options_.window);
+        last_decay_ = now - elapsed % options_.window;
+        decayed_ = true;
+        for (auto& c : sketch_) c.store(c.load(memory_order_relaxed) >> halvings, memory_order_relaxed);
+        total_.store(total_.load(memory_order_relaxed) >> halvings, memory_order_relaxed);
+        for (auto& s : shards_) {
+            s.reads >>= halvings;
+            s.writes >>= halvings;
+        }
+        vector<Entry> kept;
+        index_.clear();
+        min_valid_ = false;
+        for (auto& e : entries_) {
+            e.count >>= halvings;
+            e.error >>= halvings;
+            e.writes >>= halvings;
+            if (e.count == 0) continue;
+            index_.emplace(e.key, kept.size());
+            kept.push_back(move(e));
+        }
+        entries_ = move(kept);
+    }
+
+    // Samples -> accesses per second, per the steady-state count above. Before the first
+    // halving the count simply covers the time since start.
+    double rate_scale() const {
+        auto now = chrono::steady_clock::now();
+        double covered = chrono::duration<double>(now - (decayed_ ? last_decay_ - options_.window : started_)).count();
+        return options_.sample_every / max(covered, 1e-3);
+    }
+
+    shared_ptr<ShardedKVCache> cache_;
+    Options options_;
+    uint64_t id_;
+    vector<atomic<uint32_t>> sketch_;
+    atomic<uint64_t> total_{0};
+    mutex mutex_;
+    vector<Entry> entries_;
+    unordered_map<string, size_t> index_;
+    size_t min_index_ = 0;
+    bool min_valid_ = false;
+    vector<ShardCounts> shards_;
+    chrono::steady_clock::time_point started_;
+    chrono::steady_clock::time_point last_decay_;
+    bool decayed_ = false;
+    Counter samples_;
+};
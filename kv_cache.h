@@ -0,0 +1,358 @@
+#pragma once
+
+#include "profiled_mutex.h"
+#include "art_index.h"
+#include "progressive_hash_map.h"
+
+class ShardedKVCache {
+public:
+    // With ordered_index, every shard also keeps its keys in an ArtIndex, maintained under
+    // the shard lock on insert and delete, so scan_prefix can answer range queries.
+    explicit ShardedKVCache(size_t shard_count = 16, bool ordered_index = false)
+        : shards_(shard_count), epochs_(shard_count) {
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            shards_[i].mtx.set_name("cache.shard[" + to_string(i) + "]");
+            if (ordered_index) shards_[i].index = make_unique<ArtIndex>();
+        }
+    }
+
+    // Takes value by value so callers that are done with their buffer can move it in.
+    void create(const string& key, string value) {
+        size_t idx = get_shard_idx(key);
+        size_t value_size = value.size();
+        auto guard = lock_shard(shards_[idx]);
+        auto [found, inserted] = shards_[idx].data.try_emplace(key);
+        if (inserted && shards_[idx].index) shards_[idx].index->insert(key);
+        Entry& entry = *found;
+        entry.value = move(value);
+        entry.version = ++shards_[idx].next_version;
+        entry.derived.clear();
+        entry.derived_version = 0;
+        bump_epoch(idx);
+        KV_PROBE3(cache__insert, key.c_str(), key.size(), value_size);
+    }
+
+    // Inserts only if the key is not cached yet, so background loaders never
+    // overwrite a value that a live write has just put in place.
+    bool create_if_absent(const string& key, const string& value) {
+        size_t idx = get_shard_idx(key);
+        auto guard = lock_shard(shards_[idx]);
+        return insert_absent(idx, key, value);
+    }
+
+    // Cache-miss fill with a value read from the backend. epoch is the key's shard epoch
+    // read before the backend read; if any write or delete reached the shard since, the
+    // value may predate it and is not cached.
+    bool fill(const string& key, const string& value, uint64_t epoch) {
+        size_t idx = get_shard_idx(key);
+        auto guard = lock_shard(shards_[idx]);
+        if (this->epoch(idx) != epoch) return false;
+        return insert_absent(idx, key, value);
+    }
+
+    string read(const string& key) {
+        size_t idx = get_shard_idx(key);
+        auto guard = lock_shard(shards_[idx]);
+        if (Entry* entry = shards_[idx].data.find(key)) {
+            entry->hits++;
+            KV_PROBE3(cache__hit, key.c_str(), key.size(), entry->value.size());
+            return entry->value;
+        }
+        KV_PROBE2(cache__miss, key.c_str(), key.size());
+        return "";
+    }
+
+    // Returns derive(value) for a cached key, or "" on a miss. The derived form is memoized
+    // per entry version: the first read after a write computes it without the shard lock
+    // held, and it is only stored if the entry was not rewritten in the meantime.
+    template <typename Derive>
+    string read_derived(const string& key, Derive&& derive) {
+        size_t idx = get_shard_idx(key);
+        Shard& shard = shards_[idx];
+        string value;
+        uint64_t version;
+        {
+            auto guard = lock_shard(shard);
+            Entry* found = shard.data.find(key);
+            if (!found) {
+                KV_PROBE2(cache__miss, key.c_str(), key.size());
+                return "";
+            }
+            Entry& entry = *found;
+            entry.hits++;
+            KV_PROBE3(cache__hit, key.c_str(), key.size(), entry.value.size());
+            if (entry.derived_version == entry.version) {
+                derived_hits_.inc();
+                return entry.derived;
+            }
+            value = entry.value;
+            version = entry.version;
+        }
+
+        derive(value);
+        derived_computes_.inc();
+
+        auto guard = lock_shard(shard);
+        Entry* entry = shard.data.find(key);
+        if (entry && entry->version == version) {
+            entry->derived = value;
+            entry->derived_version = version;
+        }
+        return value;
+    }
+
+    // Adds hits served on the entry's behalf elsewhere (the near-cache) to its hit count, so
+    // hottest() still ranks keys by how often they are read.
+    void credit_hits(const string& key, uint32_t hits) {
+        size_t idx = get_shard_idx(key);
+        auto guard = lock_shard(shards_[idx]);
+        if (Entry* entry = shards_[idx].data.find(key)) {
+            entry->hits = (uint32_t)min<uint64_t>(UINT32_MAX, (uint64_t)entry->hits + hits);
+        }
+    }
+
+    void del(const string& key) {
+        size_t idx = get_shard_idx(key);
+        auto guard = lock_shard(shards_[idx]);
+        size_t erased = shards_[idx].data.erase(key);
+        if (erased && shards_[idx].index) shards_[idx].index->erase(key);
+        // Bumped even for an uncached key, so an in-flight fill() of it is dropped.
+        bump_epoch(idx);
+        KV_PROBE3(cache__delete, key.c_str(), key.size(), erased);
+    }
+
+    size_t shard_count() const {
+        return shards_.size();
+    }
+
+    size_t shard_of(const string& key) {
+        return get_shard_idx(key);
+    }
+
+    // Bumped under the shard lock by every write and delete in the shard, so a copy taken
+    // with epoch e (read before the copy) is current for as long as the epoch is still e.
+    uint64_t epoch(size_t idx) const {
+        return epochs_[idx].value.load(memory_order_acquire);
+    }
+
+    bool has_ordered_index() const {
+        return shards_[0].index != nullptr;
+    }
+
+    struct ScanPage {
+        vector<pair<string, string>> items;
+        bool more = false;   // the page was cut at limit; continue after next_cursor
+        // The last key the page covered, set when more is. Keys deleted between the listing
+        // and the value copy are missing from items, so items may even be empty; the next
+        // page still starts after this key.
+        string next_cursor;
+    };
+
+    // Returns up to limit entries in key order whose keys start with prefix and sort after
+    // bound (or equal it, if inclusive). Keys are spread over the shards by hash, so each
+    // shard lists a share of its first matching keys under its own lock. The merged list is
+    // exact up to the smallest last key of any shard that was cut off. If that covers less
+    // than a page, the shares double and the listing is retried. Only the page's values are
+    // copied. Requires the ordered index.
+    ScanPage scan_prefix(const string& prefix, const string& bound, bool inclusive, size_t limit) {
+        ScanPage page;
+        if (limit == 0) return page;
+        vector<pair<string, uint32_t>> keys;
+        size_t share = min(limit, 2 * limit / shards_.size() + 8);
+        while (true) {
+            keys.clear();
+            bool cut = false;
+            string horizon;
+            for (size_t idx = 0; idx < shards_.size(); ++idx) {
+                auto guard = lock_shard(shards_[idx]);
+                size_t taken = 0;
+                shards_[idx].index->scan(prefix, bound, inclusive, [&](const string& key) {
+                    keys.emplace_back(key, idx);
+                    return ++taken <= share;
+                });
+                // One key past the share is read as look-ahead; the shard is exact up to
+                // its last key within the share.
+                if (taken > share && (!cut || keys[keys.size() - 2].first < horizon)) {
+                    horizon = keys[keys.size() - 2].first;
+                    cut = true;
+                }
+            }
+            sort(keys.begin(), keys.end());
+            size_t exact = keys.size();
+            if (cut) {
+                exact = upper_bound(keys.begin(), keys.end(), make_pair(horizon, UINT32_MAX)) - keys.begin();
+            }
+            if (exact >= limit || !cut) {
+                page.more = keys.size() > min(exact, limit);
+                keys.resize(min(exact, limit));
+                break;
+            }
+            share = min(limit, share * 2);
+        }
+
+        if (page.more) page.next_cursor = keys.back().first;
+        // Keys deleted since the first pass are dropped from the page.
+        vector<string> values(keys.size());
+        vector<bool> found(keys.size());
+        for (size_t idx = 0; idx < shards_.size(); ++idx) {
+            unique_lock<ProfiledMutex> guard;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (keys[i].second != idx) continue;
+                if (!guard.owns_lock()) guard = lock_shard(shards_[idx]);
+                Entry* entry = shards_[idx].data.find(keys[i].first);
+                if (!entry) continue;
+                values[i] = entry->value;
+                found[i] = true;
+            }
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (found[i]) page.items.emplace_back(move(keys[i].first), move(values[i]));
+        }
+        return page;
+    }
+
+    void append_stats(ostream& out) {
+        out << "# TYPE kv_cache_derived_hits_total counter\n"
+            << "kv_cache_derived_hits_total " << derived_hits_.value() << "\n"
+            << "# TYPE kv_cache_derived_computes_total counter\n"
+            << "kv_cache_derived_computes_total " << derived_computes_.value() << "\n";
+        size_t resizes = 0, rehashing = 0;
+        for (auto& shard : shards_) {
+            auto guard = lock_shard(shard);
+            resizes += shard.data.resizes();
+            rehashing += shard.data.rehashing();
+        }
+        out << "# TYPE kv_cache_resizes_total counter\n"
+            << "kv_cache_resizes_total " << resizes << "\n"
+            << "# TYPE kv_cache_rehashing_shards gauge\n"
+            << "kv_cache_rehashing_shards " << rehashing << "\n";
+    }
+
+    // Copies the entries of shard idx from cursor on, ~batch_size at a time under the lock,
+    // into out and returns the cursor to continue from: 0 once the shard is done (start at 0
+    // too). Only the cursor lives between pages, so the caller may block between them.
+    uint64_t scan_shard_page(size_t idx, uint64_t cursor, size_t batch_size, vector<pair<string, string>>& out) {
+        auto guard = lock_shard(shards_[idx]);
+        return shards_[idx].data.scan(cursor, batch_size, [&](const string& key, Entry& entry) {
+            out.emplace_back(key, entry.value);
+        });
+    }
+
+    // Copies at most ~batch_size entries per lock hold and hands each batch to fn with
+    // the lock released.
+    void scan_shard(size_t idx, size_t batch_size, const function<void(vector<pair<string, string>>&)>& fn) {
+        vector<pair<string, string>> batch;
+        walk_shard(idx, batch_size,
+            [&](const string& key, Entry& entry) { batch.emplace_back(key, entry.value); },
+            [&] {
+                if (!batch.empty()) fn(batch);
+                batch.clear();
+            });
+    }
+
+    // Returns up to n keys with the most hits, hottest first. With decay, every hit
+    // counter is halved on the way so the ranking favours recent traffic.
+    vector<pair<string, uint32_t>> hottest(size_t n, bool decay) {
+        auto colder = [](const pair<uint32_t, string>& a, const pair<uint32_t, string>& b) { return a.first > b.first; };
+        priority_queue<pair<uint32_t, string>, vector<pair<uint32_t, string>>, decltype(colder)> heap(colder);
+        for (size_t idx = 0; idx < shards_.size(); ++idx) {
+            walk_shard(idx, 4096,
+                [&](const string& key, Entry& entry) {
+                    uint32_t hits = entry.hits;
+                    if (decay) entry.hits /= 2;
+                    if (hits == 0 || n == 0) return;
+                    if (heap.size() < n) {
+                        heap.emplace(hits, key);
+                    } else if (hits > heap.top().first) {
+                        heap.pop();
+                        heap.emplace(hits, key);
+                    }
+                },
+                [] {});
+        }
+        vector<pair<string, uint32_t>> result;
+        while (!heap.empty()) {
+            result.emplace_back(heap.top().second, heap.top().first);
+            heap.pop();
+        }
+        reverse(result.begin(), result.end());
+        return result;
+    }
+
+private:
+    // version is bumped on every write; derived is valid only while derived_version matches.
+    struct Entry {
+        string value;
+        uint32_t hits = 0;
+        uint64_t version = 0;
+        uint64_t derived_version = 0;
+        string derived;
+    };
+
+    struct Shard {
+        ProfiledMutex mtx;
+        ProgressiveHashMap<Entry> data;
+        uint64_t next_version = 0;
+        unique_ptr<ArtIndex> index;
+    };
+
+    // Kept apart from the shards so that reading an epoch does not pull in a cache line
+    // that lock traffic keeps bouncing between cores.
+    struct alignas(64) Epoch {
+        atomic<uint64_t> value{0};
+    };
+
+    vector<Shard> shards_;
+    vector<Epoch> epochs_;
+    Counter derived_hits_;
+    Counter derived_computes_;
+
+    unique_lock<ProfiledMutex> lock_shard(Shard& shard) {
+        auto start = chrono::steady_clock::now();
+        unique_lock<ProfiledMutex> lock(shard.mtx);
+        stage_metrics().shard_lock_wait.record_span(start, chrono::steady_clock::now());
+        return lock;
+    }
+
+    size_t get_shard_idx(const string& key) {
+        hash<string> hasher;
+        return hasher(key) % shards_.size();
+    }
+
+    // Caller holds the shard lock.
+    bool insert_absent(size_t idx, const string& key, const string& value) {
+        Entry entry;
+        entry.value = value;
+        entry.version = shards_[idx].next_version + 1;
+        bool inserted = shards_[idx].data.try_emplace(key, move(entry)).second;
+        if (inserted) {
+            shards_[idx].next_version++;
+            if (shards_[idx].index) shards_[idx].index->insert(key);
+            bump_epoch(idx);
+            KV_PROBE3(cache__insert, key.c_str(), key.size(), value.size());
+        }
+        return inserted;
+    }
+
+    // Only called with the shard lock held, so a plain increment is enough.
+    void bump_epoch(size_t idx) {
+        auto& epoch = epochs_[idx].value;
+        epoch.store(epoch.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    // Visits one shard in slices: visit runs under the shard lock for ~max_entries entries
+    // at a time, after_batch once the lock is released again. Between slices only the map's
+    // scan cursor is kept, so writes, growth and rehashing carry on while after_batch runs.
+    template <typename Visit, typename AfterBatch>
+    void walk_shard(size_t idx, size_t max_entries, Visit&& visit, AfterBatch&& after_batch) {
+        Shard& shard = shards_[idx];
+        uint64_t cursor = 0;
+        do {
+            {
+                auto guard = lock_shard(shard);
+                cursor = shard.data.scan(cursor, max_entries, visit);
+            }
+            after_batch();
+        } while (cursor != 0);
+    }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <stdexcept>
+#include <fstream>
+#include <unistd.h> 
+#include <fcntl.h>
+#include <vector>
+#include <queue>
+#include <list>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <sys/resource.h> 
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <array>
+#include <cstring>
+#include <string_view>
+#include <shared_mutex>
+#include <filesystem>
+#include <sys/mman.h>
+#include <cmath>
+#include <iomanip>
+#include <charconv>
+
+// USDT tracepoints for perf/bpftrace/systemtap (provider "kvserver"). Each one compiles to
+// a single nop plus an ELF note, survives inlining, and only costs a trap while a tracer is
+// attached. Built in whenever <sys/sdt.h> (systemtap-sdt-dev) is present; -DKV_NO_USDT opts out.
+//
+// The nop does not stop the arguments from being computed, so every probe also gets a
+// semaphore that tracers increment while attached. Call sites whose arguments cost more
+// than a load wrap the probe in if (KV_PROBE_ENABLED(name)). A new probe needs a
+// KV_PROBE_SEMAPHORE line below.
+#if !defined(KV_NO_USDT) && __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define KV_PROBE_SEMAPHORE(name)                                                                  \
+    __attribute__((weak, section(".probes"))) volatile unsigned short kvserver_##name##_semaphore \
+        __asm__("kvserver_" #name "_semaphore") = 0
+#define KV_PROBE_ENABLED(name) __builtin_expect(kvserver_##name##_semaphore != 0, 0)
+#define KV_PROBE1(name, a) DTRACE_PROBE1(kvserver, name, a)
+#define KV_PROBE2(name, a, b) DTRACE_PROBE2(kvserver, name, a, b)
+#define KV_PROBE3(name, a, b, c) DTRACE_PROBE3(kvserver, name, a, b, c)
+#else
+#define KV_PROBE_SEMAPHORE(name) static_assert(true, "")
+#define KV_PROBE_ENABLED(name) false
+#define KV_PROBE1(name, a) do { (void)sizeof(a); } while (0)
+#define KV_PROBE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define KV_PROBE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
+
+KV_PROBE_SEMAPHORE(cache__hit);
+KV_PROBE_SEMAPHORE(cache__miss);
+KV_PROBE_SEMAPHORE(cache__insert);
+KV_PROBE_SEMAPHORE(cache__delete);
+KV_PROBE_SEMAPHORE(wal__enqueue);
+KV_PROBE_SEMAPHORE(wal__batch__write);
+KV_PROBE_SEMAPHORE(wal__fsync);
+KV_PROBE_SEMAPHORE(pool__acquire);
+KV_PROBE_SEMAPHORE(pool__release);
+
+using namespace std;
+
+inline uint32_t crc32(const char* data, size_t len, uint32_t crc = 0) {
+    static const auto table = [] {
+        array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline string json_escape(const string& s) {
+    string out;
+    out.reserve(s.size() + 2);
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+// Parses the JSON string literal starting at p (which must point at the opening quote)
+// into out and leaves p just past the closing quote. Returns false on malformed input.
+inline bool json_read_string(const char*& p, const char* end, string& out) {
+    if (p == end || *p != '"') return false;
+    out.clear();
+    for (++p; p < end; ++p) {
+        char c = *p;
+        if (c == '"') {
+            ++p;
+            return true;
+        }
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (++p == end) return false;
+        switch (*p) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                auto hex4 = [&](uint32_t& cp) {
+                    if (end - p < 5) return false;
+                    cp = 0;
+                    for (int i = 1; i <= 4; ++i) {
+                        char h = p[i];
+                        int d = h >= '0' && h <= '9' ? h - '0' : h >= 'a' && h <= 'f' ? h - 'a' + 10
+                              : h >= 'A' && h <= 'F' ? h - 'A' + 10 : -1;
+                        if (d < 0) return false;
+                        cp = cp << 4 | d;
+                    }
+                    p += 4;
+                    return true;
+                };
+                uint32_t cp;
+                if (!hex4(cp)) return false;
+                if (cp >= 0xD800 && cp < 0xDC00 && end - p > 2 && p[1] == '\\' && p[2] == 'u') {
+                    p += 2;
+                    uint32_t low;
+                    if (!hex4(low)) return false;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                if (cp < 0x80) {
+                    out += (char)cp;
+                } else if (cp < 0x800) {
+                    out += (char)(0xC0 | cp >> 6);
+                    out += (char)(0x80 | (cp & 0x3F));
+                } else if (cp < 0x10000) {
+                    out += (char)(0xE0 | cp >> 12);
+                    out += (char)(0x80 | (cp >> 6 & 0x3F));
+                    out += (char)(0x80 | (cp & 0x3F));
+                } else {
+                    out += (char)(0xF0 | cp >> 18);
+                    out += (char)(0x80 | (cp >> 12 & 0x3F));
+                    out += (char)(0x80 | (cp >> 6 & 0x3F));
+                    out += (char)(0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default: return false;
+        }
+    }
+    return false;
+}
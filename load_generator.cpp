@@ -9,41 +9,309 @@
 #include <sstream>
 #include <random>
 #include <iomanip>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <cmath>
+#include <fstream>
+#include <deque>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
 
 using namespace std;
 
-atomic<long long> total_requests_completed(0);
-atomic<long long> total_requests_failed(0);
-atomic<long long> total_response_time_ms(0);
 atomic<bool> test_running(true);
+// Offered load in requests/second across all worker threads; 0 keeps the closed loop.
+atomic<double> target_rate(0);
+int total_threads = 1;
 
 int popular_key_count = 100;
 vector<string> popular_keys;
 
+enum OpType { OP_PUT, OP_GET, OP_DELETE, OP_UPDATE, OP_INSERT, OP_SCAN, OP_RMW, OP_COUNT };
+// A 404 is a completed request (a miss), not a failure.
+enum Outcome { OUT_OK, OUT_NOT_FOUND, OUT_4XX, OUT_5XX, OUT_ERROR, OUT_COUNT };
+const char* op_names[OP_COUNT] = {"PUT", "GET", "DELETE", "UPDATE", "INSERT", "SCAN", "READ_MODIFY_WRITE"};
+const char* outcome_names[OUT_COUNT] = {"ok", "not_found", "4xx", "5xx", "error"};
+
+// HDR-style log-linear histogram over nanoseconds (8 sub-buckets per power of two, <12.5%
+// error). Written by a single thread with relaxed stores, read by the monitor thread.
+class LatencyHistogram {
+public:
+    static const int kSubBits = 3;
+    static const size_t kSub = 1 << kSubBits;
+    static const int kMaxBits = 40;
+    static const size_t kBuckets = (kMaxBits - kSubBits + 1) * kSub;
+
+    struct Snapshot {
+        vector<uint64_t> counts = vector<uint64_t>(kBuckets, 0);
+        uint64_t total = 0;
+        uint64_t sum_ns = 0;
+        uint64_t max_ns = 0;
+
+        void merge(const Snapshot& o) {
+            for (size_t i = 0; i < kBuckets; ++i) counts[i] += o.counts[i];
+            total += o.total;
+            sum_ns += o.sum_ns;
+            max_ns = max(max_ns, o.max_ns);
+        }
+
+        // Interval view: this minus an earlier snapshot of the same histogram. The exact
+        // max is only known cumulatively, so the interval max is the top bucket's bound.
+        Snapshot since(const Snapshot& earlier) const {
+            Snapshot d;
+            for (size_t i = 0; i < kBuckets; ++i) {
+                d.counts[i] = counts[i] - earlier.counts[i];
+                if (d.counts[i]) d.max_ns = bucket_upper_ns(i);
+            }
+            d.total = total - earlier.total;
+            d.sum_ns = sum_ns - earlier.sum_ns;
+            d.max_ns = min(d.max_ns, max_ns);
+            return d;
+        }
+
+        uint64_t percentile_ns(double q) const {
+            if (total == 0) return 0;
+            uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(q * total));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; ++i) {
+                seen += counts[i];
+                if (seen >= rank) return min(bucket_upper_ns(i), max_ns);
+            }
+            return max_ns;
+        }
+    };
+
+    void record(uint64_t ns) {
+        bump(counts_[bucket_index(ns)], 1);
+        bump(total_, 1);
+        bump(sum_ns_, ns);
+        if (ns > max_ns_.load(memory_order_relaxed)) max_ns_.store(ns, memory_order_relaxed);
+    }
+
+    void add_to(Snapshot& s) const {
+        for (size_t i = 0; i < kBuckets; ++i) s.counts[i] += counts_[i].load(memory_order_relaxed);
+        s.total += total_.load(memory_order_relaxed);
+        s.sum_ns += sum_ns_.load(memory_order_relaxed);
+        s.max_ns = max(s.max_ns, max_ns_.load(memory_order_relaxed));
+    }
+
+    static size_t bucket_index(uint64_t v) {
+        v = min<uint64_t>(v, (1ull << kMaxBits) - 1);
+        if (v < kSub) return v;
+        int msb = 63 - __builtin_clzll(v);
+        return (msb - kSubBits + 1) * kSub + ((v >> (msb - kSubBits)) & (kSub - 1));
+    }
+
+    static uint64_t bucket_upper_ns(size_t idx) {
+        if (idx < kSub) return idx + 1;
+        int shift = idx / kSub - 1;
+        return (kSub + idx % kSub + 1) << shift;
+    }
+
+private:
+    static void bump(atomic<uint64_t>& a, uint64_t n) {
+        a.store(a.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    array<atomic<uint64_t>, kBuckets> counts_{};
+    atomic<uint64_t> total_{0};
+    atomic<uint64_t> sum_ns_{0};
+    atomic<uint64_t> max_ns_{0};
+};
+
+struct ThreadStats {
+    LatencyHistogram hist[OP_COUNT][OUT_COUNT];
+    LatencyHistogram service;  // open loop only: time from actual send, without queueing delay
+};
+
+mutex stats_mutex;
+vector<unique_ptr<ThreadStats>> all_thread_stats;
+
+ThreadStats* register_thread_stats() {
+    lock_guard<mutex> lock(stats_mutex);
+    all_thread_stats.push_back(make_unique<ThreadStats>());
+    return all_thread_stats.back().get();
+}
+
+struct StatsSnapshot {
+    LatencyHistogram::Snapshot hist[OP_COUNT][OUT_COUNT];
+    LatencyHistogram::Snapshot service;
+
+    uint64_t count(Outcome outcome) const {
+        uint64_t n = 0;
+        for (int op = 0; op < OP_COUNT; ++op) n += hist[op][outcome].total;
+        return n;
+    }
+
+    uint64_t failed() const {
+        return count(OUT_4XX) + count(OUT_5XX) + count(OUT_ERROR);
+    }
+
+    LatencyHistogram::Snapshot completed() const {
+        LatencyHistogram::Snapshot s;
+        for (int op = 0; op < OP_COUNT; ++op) {
+            s.merge(hist[op][OUT_OK]);
+            s.merge(hist[op][OUT_NOT_FOUND]);
+        }
+        return s;
+    }
+
+    StatsSnapshot since(const StatsSnapshot& earlier) const {
+        StatsSnapshot d;
+        for (int op = 0; op < OP_COUNT; ++op)
+            for (int o = 0; o < OUT_COUNT; ++o) d.hist[op][o] = hist[op][o].since(earlier.hist[op][o]);
+        d.service = service.since(earlier.service);
+        return d;
+    }
+};
+
+StatsSnapshot collect_stats() {
+    StatsSnapshot s;
+    lock_guard<mutex> lock(stats_mutex);
+    for (const auto& t : all_thread_stats) {
+        for (int op = 0; op < OP_COUNT; ++op)
+            for (int o = 0; o < OUT_COUNT; ++o) t->hist[op][o].add_to(s.hist[op][o]);
+        t->service.add_to(s.service);
+    }
+    return s;
+}
+
+// Paces one worker thread on a fixed schedule (wrk2-style open loop). Each request has an
+// intended send time; when the server stalls the thread falls behind and sends the backlog
+// immediately, and latency is measured from the intended time so the stall is not hidden.
+class Pacer {
+public:
+    Pacer(int thread_id, int num_threads) : thread_id_(thread_id), num_threads_(num_threads) {}
+
+    bool open_loop() const { return target_rate.load(memory_order_relaxed) > 0; }
+
+    // Returns the intended send time of the next request, sleeping until then if ahead of
+    // schedule. In closed-loop mode that is simply now. Never sleeps past deadline.
+    chrono::steady_clock::time_point next(chrono::steady_clock::time_point deadline) {
+        auto now = chrono::steady_clock::now();
+        double rate = target_rate.load(memory_order_relaxed);
+        if (rate <= 0) {
+            started_ = false;
+            return now;
+        }
+        auto interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(num_threads_ / rate));
+        if (!started_) {
+            // Stagger threads across one interval so they do not fire in lockstep.
+            next_ = now + interval * thread_id_ / num_threads_;
+            started_ = true;
+        } else {
+            next_ += interval;
+        }
+        if (next_ > now) this_thread::sleep_until(min(next_, deadline));
+        return next_;
+    }
+
+private:
+    int thread_id_;
+    int num_threads_;
+    bool started_ = false;
+    chrono::steady_clock::time_point next_;
+};
+
+Outcome classify(const httplib::Result& res) {
+    if (!res) return OUT_ERROR;
+    if (res->status >= 200 && res->status < 300) return OUT_OK;
+    if (res->status == 404) return OUT_NOT_FOUND;
+    if (res->status >= 400 && res->status < 500) return OUT_4XX;
+    return OUT_5XX;
+}
+
+void record_outcome(ThreadStats* stats, OpType op, Outcome outcome, chrono::steady_clock::time_point start) {
+    uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    stats->hist[op][outcome].record(ns);
+}
+
+void record_result(ThreadStats* stats, OpType op, const httplib::Result& res, chrono::steady_clock::time_point start) {
+    record_outcome(stats, op, classify(res), start);
+}
+
+void record_service(ThreadStats* stats, chrono::steady_clock::time_point sent) {
+    stats->service.record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sent).count());
+}
+
+string latency_json(const LatencyHistogram::Snapshot& s) {
+    stringstream out;
+    out << fixed << setprecision(1) << "{\"count\":" << s.total
+        << ",\"mean_us\":" << (s.total ? s.sum_ns / 1000.0 / s.total : 0.0)
+        << ",\"p50_us\":" << s.percentile_ns(0.50) / 1000.0
+        << ",\"p90_us\":" << s.percentile_ns(0.90) / 1000.0
+        << ",\"p99_us\":" << s.percentile_ns(0.99) / 1000.0
+        << ",\"p999_us\":" << s.percentile_ns(0.999) / 1000.0
+        << ",\"max_us\":" << s.max_ns / 1000.0 << "}";
+    return out.str();
+}
+
+// {"GET":{"ok":{...},"error":{...}},...} with empty op/outcome combinations left out.
+string ops_json(const StatsSnapshot& s) {
+    stringstream out;
+    out << "{";
+    bool first_op = true;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        bool any = false;
+        for (int o = 0; o < OUT_COUNT; ++o) any = any || s.hist[op][o].total > 0;
+        if (!any) continue;
+        out << (first_op ? "" : ",") << "\"" << op_names[op] << "\":{";
+        first_op = false;
+        bool first_outcome = true;
+        for (int o = 0; o < OUT_COUNT; ++o) {
+            if (s.hist[op][o].total == 0) continue;
+            out << (first_outcome ? "" : ",") << "\"" << outcome_names[o] << "\":" << latency_json(s.hist[op][o]);
+            first_outcome = false;
+        }
+        out << "}";
+    }
+    out << "}";
+    return out.str();
+}
+
 void monitor_performance() {
-    long long last_requests = 0;
-    long long last_response_time = 0;
+    StatsSnapshot last;
+    int second = 0;
 
     while (test_running) {
         this_thread::sleep_for(chrono::seconds(1));
-        
-        long long current_requests = total_requests_completed.load();
-        long long current_response_time = total_response_time_ms.load();
-        long long failed = total_requests_failed.load();
-        
-        long long delta_requests = current_requests - last_requests;
-        long long delta_time = current_response_time - last_response_time;
-        
-        double throughput = (double)delta_requests; 
-        double avg_latency = (delta_requests > 0) ? (double)delta_time / delta_requests : 0.0;
+        second++;
+
+        StatsSnapshot current = collect_stats();
+        StatsSnapshot delta = current.since(last);
+        LatencyHistogram::Snapshot ok = delta.completed();
 
-        cout << "[METRICS] " << fixed << setprecision(2) << throughput << " " << avg_latency << " " << failed << endl;
+        double throughput = (double)ok.total;
+        double avg_latency = (ok.total > 0) ? ok.sum_ns / 1e6 / ok.total : 0.0;
 
-        last_requests = current_requests;
-        last_response_time = current_response_time;
+        cout << "[METRICS] " << fixed << setprecision(2) << throughput << " " << avg_latency << " " << current.failed() << endl;
+        cout << "[METRICS_JSON] {\"second\":" << second << ",\"throughput\":" << ok.total
+             << ",\"failed_total\":" << current.failed() << ",\"latency\":" << latency_json(ok)
+             << ",\"ops\":" << ops_json(delta) << "}" << endl;
+
+        last = current;
     }
 }
 
+// --write-method=put sends writes as PUT /kv/:key with the value as the raw body
+// instead of a form-encoded POST /kv.
+bool raw_put = false;
+
+httplib::Result put_kv(httplib::Client& cli, const string& key, const string& value) {
+    if (raw_put) return cli.Put(("/kv/" + key).c_str(), value, "application/octet-stream");
+    httplib::Params params;
+    params.emplace("key", key);
+    params.emplace("value", value);
+    return cli.Post("/kv", params);
+}
+
 void warmup(const string& host, int port) {
     httplib::Client cli(host, port);
     cli.set_connection_timeout(5, 0);
@@ -52,11 +320,7 @@ void warmup(const string& host, int port) {
         string key = "Popular_key_" + to_string(i);
         popular_keys.push_back(key);
 
-        httplib::Params params;
-        params.emplace("key", key);
-        params.emplace("value", "Popular_value_" + to_string(i));
-        
-        cli.Post("/kv", params);
+        put_kv(cli, key, "Popular_value_" + to_string(i));
     }
 }
 
@@ -64,34 +328,28 @@ void put_all_task(const string& host, int port, int duration_seconds, int thread
     httplib::Client cli(host, port);
     cli.set_connection_timeout(2, 0);
     cli.set_read_timeout(5, 0);
-    
+
     auto start_time = chrono::steady_clock::now();
     auto end_time = start_time + chrono::seconds(duration_seconds);
 
+    ThreadStats* stats = register_thread_stats();
+    Pacer pacer(thread_id, total_threads);
     int request_count = 0;
     while (chrono::steady_clock::now() < end_time) {
         stringstream ss_key;
         ss_key << "key_" << thread_id << "_" << request_count;
-        
-        httplib::Params params;
-        params.emplace("key", ss_key.str());
-        params.emplace("value", "Value_data_payload_12345");
 
-        auto req_start = chrono::steady_clock::now();
-        
-        try {
-            auto res = cli.Post("/kv", params);
-            auto req_end = chrono::steady_clock::now();
+        auto req_start = pacer.next(end_time);
+        if (req_start >= end_time) break;
+        auto sent = chrono::steady_clock::now();
 
-            if (res && res->status == 200) {
-                total_requests_completed++;
-                total_response_time_ms += chrono::duration_cast<chrono::milliseconds>(req_end - req_start).count();
-            } else {
-                total_requests_failed++;
-            }
+        try {
+            auto res = put_kv(cli, ss_key.str(), "Value_data_payload_12345");
+            record_result(stats, OP_PUT, res, req_start);
         } catch (...) {
-            total_requests_failed++;
+            stats->hist[OP_PUT][OUT_ERROR].record(0);
         }
+        if (pacer.open_loop()) record_service(stats, sent);
         request_count++;
     }
 }
@@ -99,34 +357,819 @@ void put_all_task(const string& host, int port, int duration_seconds, int thread
 void get_popular_task(const string& host, int port, int duration_seconds, int thread_id) {
     httplib::Client cli(host, port);
     cli.set_connection_timeout(2, 0);
-    
+
     auto start_time = chrono::steady_clock::now();
     auto end_time = start_time + chrono::seconds(duration_seconds);
     mt19937 gen(hash<thread::id>{}(this_thread::get_id()));
     uniform_int_distribution<> dist(0, popular_key_count - 1);
+    ThreadStats* stats = register_thread_stats();
+    Pacer pacer(thread_id, total_threads);
 
     while (chrono::steady_clock::now() < end_time) {
         string key = popular_keys[dist(gen)];
-        auto req_start = chrono::steady_clock::now();
-        
+        auto req_start = pacer.next(end_time);
+        if (req_start >= end_time) break;
+        auto sent = chrono::steady_clock::now();
+
         try {
             auto res = cli.Get(("/kv/" + key).c_str());
-            auto req_end = chrono::steady_clock::now();
+            record_result(stats, OP_GET, res, req_start);
+        } catch (...) {
+            stats->hist[OP_GET][OUT_ERROR].record(0);
+        }
+        if (pacer.open_loop()) record_service(stats, sent);
+    }
+}
+
+// YCSB-style workloads (Cooper et al., "Benchmarking Cloud Serving Systems with YCSB").
+struct YcsbConfig {
+    double read = 0.5, update = 0.5, insert = 0, del = 0, scan = 0, rmw = 0;
+    string dist = "zipfian";
+    double theta = 0.99;
+    double hot_data = 0.2, hot_ops = 0.8;
+    long long record_count = 100000;
+    size_t value_min = 100, value_max = 100;
+    int max_scan_length = 100;
+    bool load = true;
+    bool bulk_load = false;
+};
+
+YcsbConfig ycsb;
+atomic<long long> ycsb_next_insert(0);
+
+bool apply_ycsb_preset(char workload) {
+    YcsbConfig& c = ycsb;
+    c.read = c.update = c.insert = c.del = c.scan = c.rmw = 0;
+    c.dist = "zipfian";
+    switch (workload) {
+        case 'a': c.read = 0.5; c.update = 0.5; break;
+        case 'b': c.read = 0.95; c.update = 0.05; break;
+        case 'c': c.read = 1.0; break;
+        case 'd': c.read = 0.95; c.insert = 0.05; c.dist = "latest"; break;
+        case 'e': c.scan = 0.95; c.insert = 0.05; break;
+        case 'f': c.read = 0.5; c.rmw = 0.5; break;
+        default: return false;
+    }
+    return true;
+}
+
+// Gray et al. zipfian generator over [0, n), as used by YCSB. Item 0 is the most popular.
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+        double zeta2 = zeta(2, theta);
+        zetan_ = zeta(n, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+    }
+
+    uint64_t next(mt19937_64& gen) const {
+        double u = uniform_real_distribution<double>(0, 1)(gen);
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + pow(0.5, theta_)) return 1;
+        return min<uint64_t>(n_ - 1, (uint64_t)(n_ * pow(eta_ * u - eta_ + 1, alpha_)));
+    }
+
+private:
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1.0 / pow((double)i, theta);
+        return sum;
+    }
+
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+uint64_t fnv1a64(uint64_t v) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < 8; ++i) {
+        h ^= (v >> (i * 8)) & 0xff;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Picks record numbers for reads/updates/deletes/scans according to ycsb.dist.
+class KeyChooser {
+public:
+    KeyChooser() {
+        if (ycsb.dist == "zipfian" || ycsb.dist == "latest") {
+            zipf_ = make_unique<ZipfianGenerator>(ycsb.record_count, ycsb.theta);
+        }
+    }
+
+    long long next(mt19937_64& gen) const {
+        long long n = max(1LL, ycsb_next_insert.load(memory_order_relaxed));
+        if (ycsb.dist == "zipfian") {
+            // Scrambled so the popular records are spread over the keyspace, not clustered at 0.
+            return fnv1a64(zipf_->next(gen)) % ycsb.record_count;
+        }
+        if (ycsb.dist == "latest") {
+            return max(0LL, n - 1 - (long long)zipf_->next(gen));
+        }
+        if (ycsb.dist == "hotspot") {
+            long long hot = max(1LL, (long long)(n * ycsb.hot_data));
+            if (uniform_real_distribution<double>(0, 1)(gen) < ycsb.hot_ops || hot >= n) {
+                return uniform_int_distribution<long long>(0, hot - 1)(gen);
+            }
+            return uniform_int_distribution<long long>(hot, n - 1)(gen);
+        }
+        return uniform_int_distribution<long long>(0, n - 1)(gen);
+    }
+
+private:
+    unique_ptr<ZipfianGenerator> zipf_;
+};
+
+unique_ptr<KeyChooser> key_chooser;
+
+string ycsb_key(long long keynum) {
+    return "user" + to_string(keynum);
+}
 
-            if (res && res->status == 200) {
-                total_requests_completed++;
-                total_response_time_ms += chrono::duration_cast<chrono::milliseconds>(req_end - req_start).count();
+// Value of "name" in one flat JSON object line: string contents unescaped, numbers as text.
+string json_field(const string& line, const string& name) {
+    string needle = "\"" + name + "\":";
+    size_t pos = line.find(needle);
+    if (pos == string::npos) return "";
+    pos += needle.size();
+    if (line[pos] != '"') {
+        size_t end = line.find_first_of(",}", pos);
+        return line.substr(pos, end - pos);
+    }
+    string out;
+    for (++pos; pos < line.size() && line[pos] != '"'; ++pos) {
+        if (line[pos] != '\\' || pos + 1 >= line.size()) {
+            out += line[pos];
+            continue;
+        }
+        char c = line[++pos];
+        if (c == 'u' && pos + 4 < line.size()) {
+            out += (char)stoi(line.substr(pos + 1, 4), nullptr, 16);
+            pos += 4;
+        } else {
+            out += c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c;
+        }
+    }
+    return out;
+}
+
+// Values are slices of a per-thread random buffer, so building one costs no RNG per byte.
+class ValueSource {
+public:
+    explicit ValueSource(mt19937_64& gen) : gen_(gen) {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+        buffer_.resize(ycsb.value_max * 2 + 64);
+        uniform_int_distribution<int> pick(0, sizeof(alphabet) - 2);
+        for (auto& c : buffer_) c = alphabet[pick(gen_)];
+    }
+
+    string next() {
+        size_t len = uniform_int_distribution<size_t>(ycsb.value_min, ycsb.value_max)(gen_);
+        size_t offset = uniform_int_distribution<size_t>(0, buffer_.size() - len)(gen_);
+        return buffer_.substr(offset, len);
+    }
+
+private:
+    mt19937_64& gen_;
+    string buffer_;
+};
+
+string ycsb_scan_path(long long keynum, int len) {
+    return "/kv?prefix=user&start=" + ycsb_key(keynum) + "&limit=" + to_string(len);
+}
+
+httplib::Result ycsb_put(httplib::Client& cli, long long keynum, const string& value) {
+    return put_kv(cli, ycsb_key(keynum), value);
+}
+
+// Streams this thread's share of the records to POST /admin/import as one chunked request
+// in the binary format. Returns the number of records the server did not apply.
+long long bulk_load_slice(httplib::Client& cli, int t, int num_threads, ValueSource& values) {
+    cli.set_read_timeout(300, 0);
+    long long next = t;
+    auto res = cli.Post("/admin/import?format=binary",
+        [&](size_t, httplib::DataSink& sink) {
+            string buf;
+            for (; next < ycsb.record_count && buf.size() < (1 << 20); next += num_threads) {
+                string key = ycsb_key(next), value = values.next();
+                uint32_t key_len = key.size(), value_len = value.size();
+                buf.append((const char*)&key_len, 4);
+                buf.append((const char*)&value_len, 4);
+                buf += key;
+                buf += value;
+            }
+            if (!buf.empty() && !sink.write(buf.data(), buf.size())) return false;
+            if (next >= ycsb.record_count) sink.done();
+            return true;
+        },
+        "application/octet-stream");
+    long long expected = t < ycsb.record_count ? (ycsb.record_count - t + num_threads - 1) / num_threads : 0;
+    if (!res || res->status != 200) {
+        if (res) cerr << "[LOAD] Import failed: " << res->body << endl;
+        return expected;
+    }
+    return expected - stoll(json_field(res->body, "records"));
+}
+
+// Inserts records [0, record_count) split across threads before the run phase.
+void ycsb_load(const string& host, int port, int num_threads) {
+    auto start = chrono::steady_clock::now();
+    atomic<long long> failed(0);
+    vector<thread> loaders;
+    for (int t = 0; t < num_threads; ++t) {
+        loaders.emplace_back([&, t] {
+            httplib::Client cli(host, port);
+            cli.set_connection_timeout(5, 0);
+            mt19937_64 gen(t);
+            ValueSource values(gen);
+            if (ycsb.bulk_load) {
+                failed += bulk_load_slice(cli, t, num_threads, values);
+                return;
+            }
+            for (long long k = t; k < ycsb.record_count; k += num_threads) {
+                auto res = ycsb_put(cli, k, values.next());
+                if (!res || res->status != 200) failed++;
+            }
+        });
+    }
+    for (auto& t : loaders) t.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "[LOAD] " << ycsb.record_count << " records in " << fixed << setprecision(2) << secs << " s ("
+         << failed.load() << " failed)" << endl;
+}
+
+OpType choose_ycsb_op(mt19937_64& gen) {
+    double r = uniform_real_distribution<double>(0, 1)(gen);
+    if ((r -= ycsb.read) < 0) return OP_GET;
+    if ((r -= ycsb.update) < 0) return OP_UPDATE;
+    if ((r -= ycsb.insert) < 0) return OP_INSERT;
+    if ((r -= ycsb.del) < 0) return OP_DELETE;
+    if ((r -= ycsb.scan) < 0) return OP_SCAN;
+    return OP_RMW;
+}
+
+void ycsb_task(const string& host, int port, int duration_seconds, int thread_id) {
+    httplib::Client cli(host, port);
+    cli.set_connection_timeout(2, 0);
+    cli.set_read_timeout(5, 0);
+
+    auto end_time = chrono::steady_clock::now() + chrono::seconds(duration_seconds);
+    mt19937_64 gen(hash<thread::id>{}(this_thread::get_id()));
+    ValueSource values(gen);
+    ThreadStats* stats = register_thread_stats();
+    Pacer pacer(thread_id, total_threads);
+    bool range_scans = true;
+
+    while (chrono::steady_clock::now() < end_time) {
+        OpType op = choose_ycsb_op(gen);
+
+        auto req_start = pacer.next(end_time);
+        if (req_start >= end_time) break;
+        auto sent = chrono::steady_clock::now();
+
+        Outcome outcome = OUT_ERROR;
+        try {
+            if (op == OP_INSERT) {
+                outcome = classify(ycsb_put(cli, ycsb_next_insert.fetch_add(1), values.next()));
             } else {
-                total_requests_failed++;
+                long long keynum = key_chooser->next(gen);
+                string path = "/kv/" + ycsb_key(keynum);
+                if (op == OP_GET) {
+                    outcome = classify(cli.Get(path.c_str()));
+                } else if (op == OP_UPDATE) {
+                    outcome = classify(ycsb_put(cli, keynum, values.next()));
+                } else if (op == OP_DELETE) {
+                    outcome = classify(cli.Delete(path.c_str()));
+                } else if (op == OP_SCAN) {
+                    // One ordered range read from the start key. Servers without the ordered
+                    // index answer 501; the thread then falls back to point reads over
+                    // consecutive record numbers, reported with their worst outcome.
+                    int len = uniform_int_distribution<int>(1, ycsb.max_scan_length)(gen);
+                    httplib::Result res;
+                    if (range_scans) {
+                        res = cli.Get(ycsb_scan_path(keynum, len).c_str());
+                        if (res && res->status == 501) range_scans = false;
+                    }
+                    if (range_scans) {
+                        outcome = classify(res);
+                    } else {
+                        outcome = OUT_OK;
+                        for (int i = 0; i < len; ++i) {
+                            outcome = max(outcome, classify(cli.Get(("/kv/" + ycsb_key(keynum + i)).c_str())));
+                        }
+                    }
+                } else {
+                    outcome = classify(cli.Get(path.c_str()));
+                    if (outcome == OUT_OK || outcome == OUT_NOT_FOUND) {
+                        outcome = classify(ycsb_put(cli, keynum, values.next()));
+                    }
+                }
             }
         } catch (...) {
-            total_requests_failed++;
+            outcome = OUT_ERROR;
         }
+        record_outcome(stats, op, outcome, req_start);
+        if (pacer.open_loop()) record_service(stats, sent);
     }
 }
 
+// Replays a request capture written by the server (--capture-path). Records are split across
+// threads by key, so each key's requests keep their original order, and every request is sent
+// at its captured offset divided by --replay-speed. Latency is measured from that intended time.
+struct ReplayRecord {
+    int64_t offset_us;
+    OpType op;
+    string key;
+    size_t value_size;
+};
+
+vector<vector<ReplayRecord>> replay_streams;
+chrono::steady_clock::time_point replay_start;
+double replay_speed = 1.0;
+
+// Returns the captured time span in microseconds, or -1 if the file cannot be read.
+int64_t load_replay(const string& path, int num_threads) {
+    ifstream in(path);
+    if (!in) return -1;
+    replay_streams.assign(num_threads, {});
+    string line;
+    int64_t first_ts = -1, last_offset = 0;
+    size_t loaded = 0, skipped = 0;
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        string method = json_field(line, "method");
+        string route = json_field(line, "route");
+        ReplayRecord r;
+        if (method == "GET" && route == "GET /kv/:key") r.op = OP_GET;
+        else if ((method == "POST" && route == "POST /kv") || (method == "PUT" && route == "PUT /kv/:key")) r.op = OP_PUT;
+        else if (method == "DELETE" && route == "DELETE /kv/:key") r.op = OP_DELETE;
+        else {
+            skipped++;
+            continue;
+        }
+        r.key = json_field(line, "key");
+        int64_t ts = stoll(json_field(line, "ts_us"));
+        if (first_ts < 0) first_ts = ts;
+        r.offset_us = max<int64_t>(0, ts - first_ts);
+        r.value_size = stoul(json_field(line, "value_size"));
+        last_offset = max(last_offset, r.offset_us);
+        replay_streams[hash<string>{}(r.key) % num_threads].push_back(move(r));
+        loaded++;
+    }
+    // Capture threads interleave, so timestamps are only nearly sorted.
+    for (auto& stream : replay_streams) {
+        stable_sort(stream.begin(), stream.end(),
+                    [](const ReplayRecord& a, const ReplayRecord& b) { return a.offset_us < b.offset_us; });
+    }
+    cout << "[REPLAY] " << loaded << " requests over " << fixed << setprecision(2) << last_offset / 1e6
+         << " s loaded (" << skipped << " non-KV skipped), speed x" << replay_speed << endl;
+    return last_offset;
+}
+
+void replay_task(const string& host, int port, int duration_seconds, int thread_id) {
+    httplib::Client cli(host, port);
+    cli.set_connection_timeout(2, 0);
+    cli.set_read_timeout(5, 0);
+
+    auto end_time = replay_start + chrono::seconds(duration_seconds);
+    ThreadStats* stats = register_thread_stats();
+    string filler;
+
+    for (const auto& r : replay_streams[thread_id]) {
+        auto intended = replay_start + chrono::duration_cast<chrono::steady_clock::duration>(
+                                           chrono::duration<double, micro>(r.offset_us / replay_speed));
+        if (intended >= end_time) break;
+        this_thread::sleep_until(intended);
+        auto sent = chrono::steady_clock::now();
+
+        try {
+            if (r.op == OP_GET) {
+                record_result(stats, OP_GET, cli.Get(("/kv/" + r.key).c_str()), intended);
+            } else if (r.op == OP_DELETE) {
+                record_result(stats, OP_DELETE, cli.Delete(("/kv/" + r.key).c_str()), intended);
+            } else {
+                if (filler.size() < r.value_size) filler.assign(r.value_size, 'v');
+                record_result(stats, OP_PUT, put_kv(cli, r.key, filler.substr(0, r.value_size)), intended);
+            }
+        } catch (...) {
+            stats->hist[r.op][OUT_ERROR].record(0);
+        }
+        record_service(stats, sent);
+    }
+}
+
+// Event-driven engine: one epoll loop per thread drives many non-blocking keep-alive
+// connections, with up to `inflight` pipelined requests on each.
+string active_workload;
+int engine_connections = 16;
+int engine_inflight = 1;
+atomic<long long> connection_errors(0);
+
+// Builds single-request operations of the active workload as raw HTTP/1.1.
+class WireRequestBuilder {
+public:
+    WireRequestBuilder(const string& host, int port, int thread_id)
+        : host_header_(host + ":" + to_string(port)), thread_id_(thread_id),
+          gen_(hash<thread::id>{}(this_thread::get_id())) {
+        if (active_workload.rfind("ycsb", 0) == 0) values_ = make_unique<ValueSource>(gen_);
+    }
+
+    OpType next(string& wire) {
+        if (active_workload == "put_all") {
+            post(wire, "key_" + to_string(thread_id_) + "_" + to_string(request_count_++), "Value_data_payload_12345");
+            return OP_PUT;
+        }
+        if (active_workload == "get_popular") {
+            get(wire, popular_keys[uniform_int_distribution<int>(0, popular_key_count - 1)(gen_)]);
+            return OP_GET;
+        }
+        OpType op = choose_ycsb_op(gen_);
+        if (op == OP_INSERT) {
+            post(wire, ycsb_key(ycsb_next_insert.fetch_add(1)), values_->next());
+            return op;
+        }
+        long long keynum = key_chooser->next(gen_);
+        if (op == OP_SCAN) {
+            int len = uniform_int_distribution<int>(1, ycsb.max_scan_length)(gen_);
+            wire = "GET " + ycsb_scan_path(keynum, len) + " HTTP/1.1\r\nHost: " + host_header_ + "\r\n\r\n";
+            return op;
+        }
+        string key = ycsb_key(keynum);
+        if (op == OP_UPDATE) post(wire, key, values_->next());
+        else if (op == OP_DELETE) wire = "DELETE /kv/" + key + " HTTP/1.1\r\nHost: " + host_header_ + "\r\n\r\n";
+        else get(wire, key);
+        return op;
+    }
+
+private:
+    void get(string& wire, const string& key) {
+        wire = "GET /kv/" + key + " HTTP/1.1\r\nHost: " + host_header_ + "\r\n\r\n";
+    }
+
+    void post(string& wire, const string& key, const string& value) {
+        if (raw_put) {
+            wire = "PUT /kv/" + key + " HTTP/1.1\r\nHost: " + host_header_ +
+                   "\r\nContent-Type: application/octet-stream\r\nContent-Length: " + to_string(value.size()) +
+                   "\r\n\r\n" + value;
+            return;
+        }
+        httplib::Params params;
+        params.emplace("key", key);
+        params.emplace("value", value);
+        string body = httplib::detail::params_to_query_str(params);
+        wire = "POST /kv HTTP/1.1\r\nHost: " + host_header_ +
+               "\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " + to_string(body.size()) +
+               "\r\n\r\n" + body;
+    }
+
+    string host_header_;
+    int thread_id_;
+    long long request_count_ = 0;
+    mt19937_64 gen_;
+    unique_ptr<ValueSource> values_;
+};
+
+class EventLoopClient {
+public:
+    EventLoopClient(const string& host, int port, int thread_id)
+        : builder_(host, port, thread_id), pacer_rate_(target_rate.load()), thread_id_(thread_id) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) == 0 && res) {
+            memcpy(&addr_, res->ai_addr, res->ai_addrlen);
+            addr_len_ = res->ai_addrlen;
+            freeaddrinfo(res);
+        }
+        epfd_ = epoll_create1(0);
+        timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = kTimerTag;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, timerfd_, &ev);
+        conns_.resize(engine_connections);
+    }
+
+    ~EventLoopClient() {
+        for (auto& c : conns_) close_conn(c);
+        close(timerfd_);
+        close(epfd_);
+    }
+
+    void run(chrono::steady_clock::time_point end_time) {
+        stats_ = register_thread_stats();
+        for (size_t i = 0; i < conns_.size(); ++i) open_conn(i);
+
+        bool open_loop = pacer_rate_ > 0;
+        auto interval = open_loop ? chrono::duration_cast<chrono::steady_clock::duration>(
+                                        chrono::duration<double>(total_threads / pacer_rate_))
+                                  : chrono::steady_clock::duration::zero();
+        auto next_send = chrono::steady_clock::now() + interval * thread_id_ / total_threads;
+        auto drain_deadline = end_time + chrono::seconds(5);
+        vector<epoll_event> events(256);
+
+        while (true) {
+            auto now = chrono::steady_clock::now();
+            if (now < end_time) {
+                if (open_loop) {
+                    // Rate changes from a ramp apply from the next scheduled request.
+                    double rate = target_rate.load(memory_order_relaxed);
+                    if (rate > 0) {
+                        interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(total_threads / rate));
+                    }
+                    while (next_send <= now && next_send < end_time) {
+                        Queued q;
+                        q.op = builder_.next(q.wire);
+                        q.intended = next_send;
+                        backlog_.push_back(move(q));
+                        next_send += interval;
+                    }
+                }
+                dispatch(open_loop);
+            } else {
+                backlog_.clear();
+                if (outstanding() == 0 || now >= drain_deadline) break;
+            }
+
+            int timeout_ms = 100;
+            if (open_loop && now < end_time) {
+                arm_timer(next_send);
+                timeout_ms = -1;
+            }
+            int n = epoll_wait(epfd_, events.data(), events.size(), timeout_ms);
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.u64 == kTimerTag) {
+                    uint64_t expirations;
+                    while (read(timerfd_, &expirations, sizeof(expirations)) > 0) {}
+                    continue;
+                }
+                handle_event(events[i].data.u64, events[i].events);
+            }
+            check_connections();
+        }
+        for (auto& c : conns_) {
+            for (auto& f : c.inflight) stats_->hist[f.op][OUT_ERROR].record(0);
+            c.inflight.clear();
+        }
+    }
+
+private:
+    static const uint64_t kTimerTag = ~0ull;
+
+    struct Queued {
+        OpType op;
+        string wire;
+        chrono::steady_clock::time_point intended;
+    };
+
+    struct InFlight {
+        OpType op;
+        string wire;
+        chrono::steady_clock::time_point intended;
+        chrono::steady_clock::time_point sent;
+    };
+
+    struct Conn {
+        int fd = -1;
+        bool connecting = false;
+        bool want_write = false;
+        string out;
+        size_t out_off = 0;
+        string in;
+        deque<InFlight> inflight;
+        chrono::steady_clock::time_point retry_at;
+    };
+
+    size_t outstanding() const {
+        size_t n = 0;
+        for (const auto& c : conns_) n += c.inflight.size();
+        return n;
+    }
+
+    void arm_timer(chrono::steady_clock::time_point at) {
+        // steady_clock is CLOCK_MONOTONIC on Linux, so the deadline can be armed absolutely.
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(at.time_since_epoch()).count();
+        itimerspec spec{};
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = max<long long>(ns % 1000000000, spec.it_value.tv_sec ? 0 : 1);
+        timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void open_conn(size_t idx) {
+        Conn& c = conns_[idx];
+        c.fd = socket(addr_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c.connecting = true;
+        c.out.clear();
+        c.out_off = 0;
+        c.in.clear();
+        if (connect(c.fd, (sockaddr*)&addr_, addr_len_) < 0 && errno != EINPROGRESS) {
+            fail_conn(idx);
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u64 = idx;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, c.fd, &ev);
+        c.want_write = true;
+    }
+
+    void close_conn(Conn& c) {
+        if (c.fd >= 0) close(c.fd);
+        c.fd = -1;
+        c.connecting = false;
+        c.want_write = false;
+    }
+
+    // Requests already sent on a connection the server closed cleanly ("Connection: close",
+    // e.g. after its keep-alive limit) were never processed, so they go back to the front of
+    // the backlog with their original intended time.
+    void requeue_and_reopen(size_t idx) {
+        Conn& c = conns_[idx];
+        close_conn(c);
+        for (auto it = c.inflight.rbegin(); it != c.inflight.rend(); ++it) {
+            backlog_.push_front({it->op, move(it->wire), it->intended});
+        }
+        c.inflight.clear();
+        open_conn(idx);
+    }
+
+    void fail_conn(size_t idx) {
+        Conn& c = conns_[idx];
+        // An idle keep-alive connection closed by the server is not an error.
+        if (c.connecting || !c.inflight.empty()) connection_errors++;
+        close_conn(c);
+        for (auto& f : c.inflight) record_outcome(stats_, f.op, OUT_ERROR, f.intended);
+        c.inflight.clear();
+        c.retry_at = chrono::steady_clock::now() + chrono::milliseconds(100);
+    }
+
+    // Reopens closed connections and fails ones whose oldest request is past the read
+    // timeout (the same 5s the blocking client uses).
+    void check_connections() {
+        auto now = chrono::steady_clock::now();
+        for (size_t i = 0; i < conns_.size(); ++i) {
+            Conn& c = conns_[i];
+            if (c.fd >= 0 && !c.inflight.empty() && now - c.inflight.front().sent > chrono::seconds(5)) fail_conn(i);
+            if (c.fd < 0 && now >= c.retry_at) open_conn(i);
+        }
+    }
+
+    void dispatch(bool open_loop) {
+        auto now = chrono::steady_clock::now();
+        for (size_t i = 0; i < conns_.size(); ++i) {
+            Conn& c = conns_[i];
+            if (c.fd < 0 || c.connecting) continue;
+            bool added = false;
+            while ((int)c.inflight.size() < engine_inflight) {
+                InFlight f;
+                if (!backlog_.empty()) {
+                    f.op = backlog_.front().op;
+                    f.wire = move(backlog_.front().wire);
+                    f.intended = backlog_.front().intended;
+                    backlog_.pop_front();
+                } else if (!open_loop) {
+                    f.op = builder_.next(f.wire);
+                    f.intended = now;
+                } else {
+                    break;
+                }
+                f.sent = now;
+                c.out += f.wire;
+                c.inflight.push_back(move(f));
+                added = true;
+            }
+            if (added) flush(i);
+            if (backlog_.empty() && open_loop) break;
+        }
+    }
+
+    void set_want_write(size_t idx, bool want) {
+        Conn& c = conns_[idx];
+        if (c.want_write == want) return;
+        epoll_event ev{};
+        ev.events = EPOLLIN | (want ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.u64 = idx;
+        epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev);
+        c.want_write = want;
+    }
+
+    void flush(size_t idx) {
+        Conn& c = conns_[idx];
+        while (c.out_off < c.out.size()) {
+            ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.out_off += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                set_want_write(idx, true);
+                return;
+            } else {
+                fail_conn(idx);
+                return;
+            }
+        }
+        c.out.clear();
+        c.out_off = 0;
+        set_want_write(idx, false);
+    }
+
+    void handle_event(size_t idx, uint32_t events) {
+        Conn& c = conns_[idx];
+        if (c.fd < 0) return;
+        if (c.connecting) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+                fail_conn(idx);
+                return;
+            }
+            c.connecting = false;
+            set_want_write(idx, false);
+            return;
+        }
+        if (events & EPOLLOUT) flush(idx);
+        if (c.fd >= 0 && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) read_responses(idx);
+    }
+
+    void read_responses(size_t idx) {
+        Conn& c = conns_[idx];
+        char buf[64 * 1024];
+        while (true) {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                c.in.append(buf, n);
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            // EOF or reset: answers already buffered still count, the rest failed.
+            if (!parse_responses(idx)) fail_conn(idx);
+            return;
+        }
+        parse_responses(idx);
+    }
+
+    // Returns true if the server asked to close and the connection was reopened.
+    bool parse_responses(size_t idx) {
+        Conn& c = conns_[idx];
+        size_t pos = 0;
+        bool close_after = false;
+        while (!c.inflight.empty()) {
+            size_t header_end = c.in.find("\r\n\r\n", pos);
+            if (header_end == string::npos) break;
+            string headers = c.in.substr(pos, header_end - pos);
+            transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+            size_t body_len = 0;
+            size_t cl = headers.find("\r\ncontent-length:");
+            if (cl != string::npos) body_len = strtoull(headers.c_str() + cl + 17, nullptr, 10);
+            if (c.in.size() < header_end + 4 + body_len) break;
+
+            int status = headers.size() > 12 ? atoi(headers.c_str() + 9) : 0;
+            InFlight& f = c.inflight.front();
+            Outcome outcome = status >= 200 && status < 300 ? OUT_OK
+                            : status == 404 ? OUT_NOT_FOUND
+                            : status >= 400 && status < 500 ? OUT_4XX : OUT_5XX;
+            record_outcome(stats_, f.op, outcome, f.intended);
+            if (pacer_rate_ > 0) record_service(stats_, f.sent);
+            c.inflight.pop_front();
+            pos = header_end + 4 + body_len;
+            if (headers.find("\r\nconnection: close") != string::npos) {
+                close_after = true;
+                break;
+            }
+        }
+        c.in.erase(0, pos);
+        if (close_after) requeue_and_reopen(idx);
+        return close_after;
+    }
+
+    WireRequestBuilder builder_;
+    double pacer_rate_;
+    int thread_id_;
+    sockaddr_storage addr_{};
+    socklen_t addr_len_ = 0;
+    int epfd_;
+    int timerfd_;
+    vector<Conn> conns_;
+    deque<Queued> backlog_;
+    ThreadStats* stats_ = nullptr;
+};
+
+void epoll_task(const string& host, int port, int duration_seconds, int thread_id) {
+    EventLoopClient client(host, port, thread_id);
+    client.run(chrono::steady_clock::now() + chrono::seconds(duration_seconds));
+}
+
 int main(int argc, char** argv) {
-    if (argc != 6) return 1;
+    if (argc < 6) return 1;
 
     string host = argv[1];
     int port = stoi(argv[2]);
@@ -134,6 +1177,110 @@ int main(int argc, char** argv) {
     int duration_seconds = stoi(argv[4]);
     string workload_type = argv[5];
 
+    if (workload_type.rfind("ycsb_", 0) == 0 && (workload_type.size() != 6 || !apply_ycsb_preset(workload_type[5]))) {
+        cerr << "Unknown YCSB preset: " << workload_type << " (expected ycsb_a .. ycsb_f)" << endl;
+        return 1;
+    }
+
+    // Optional --name=value flags after the positional arguments.
+    string json_out;
+    double rate = 0;
+    string engine = "blocking";
+    string replay_path;
+    vector<double> ramp_rates;
+    int step_seconds = 10;
+    for (int i = 6; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.rfind("--json-out=", 0) == 0) {
+            json_out = arg.substr(11);
+        } else if (arg.rfind("--rate=", 0) == 0) {
+            rate = stod(arg.substr(7));
+        } else if (arg.rfind("--ramp=", 0) == 0) {
+            // --ramp=START:END:STEP in req/s
+            double start, end, step;
+            if (sscanf(arg.c_str() + 7, "%lf:%lf:%lf", &start, &end, &step) != 3 || start <= 0 || step <= 0) {
+                cerr << "Invalid ramp, expected --ramp=START:END:STEP" << endl;
+                return 1;
+            }
+            for (double r = start; r <= end + 1e-9; r += step) ramp_rates.push_back(r);
+        } else if (arg.rfind("--step-seconds=", 0) == 0) {
+            step_seconds = max(1, stoi(arg.substr(15)));
+        } else if (arg.rfind("--read=", 0) == 0) {
+            ycsb.read = stod(arg.substr(7));
+        } else if (arg.rfind("--update=", 0) == 0) {
+            ycsb.update = stod(arg.substr(9));
+        } else if (arg.rfind("--insert=", 0) == 0) {
+            ycsb.insert = stod(arg.substr(9));
+        } else if (arg.rfind("--delete=", 0) == 0) {
+            ycsb.del = stod(arg.substr(9));
+        } else if (arg.rfind("--scan=", 0) == 0) {
+            ycsb.scan = stod(arg.substr(7));
+        } else if (arg.rfind("--rmw=", 0) == 0) {
+            ycsb.rmw = stod(arg.substr(6));
+        } else if (arg.rfind("--dist=", 0) == 0) {
+            ycsb.dist = arg.substr(7);
+            if (ycsb.dist != "uniform" && ycsb.dist != "zipfian" && ycsb.dist != "latest" && ycsb.dist != "hotspot") {
+                cerr << "Unknown distribution: " << ycsb.dist << endl;
+                return 1;
+            }
+        } else if (arg.rfind("--theta=", 0) == 0) {
+            ycsb.theta = stod(arg.substr(8));
+            if (ycsb.theta <= 0 || ycsb.theta >= 1) {
+                cerr << "--theta must be in (0, 1)" << endl;
+                return 1;
+            }
+        } else if (arg.rfind("--hotspot=", 0) == 0) {
+            // --hotspot=DATA_FRACTION:OPS_FRACTION, e.g. 0.2:0.8
+            if (sscanf(arg.c_str() + 10, "%lf:%lf", &ycsb.hot_data, &ycsb.hot_ops) != 2) {
+                cerr << "Invalid hotspot, expected --hotspot=DATA:OPS" << endl;
+                return 1;
+            }
+        } else if (arg.rfind("--keys=", 0) == 0) {
+            ycsb.record_count = max(1LL, stoll(arg.substr(7)));
+        } else if (arg.rfind("--value-size=", 0) == 0) {
+            // --value-size=N or --value-size=MIN-MAX (uniform)
+            string v = arg.substr(13);
+            size_t dash = v.find('-');
+            ycsb.value_min = stoul(v.substr(0, dash));
+            ycsb.value_max = dash == string::npos ? ycsb.value_min : stoul(v.substr(dash + 1));
+            if (ycsb.value_max < ycsb.value_min) swap(ycsb.value_min, ycsb.value_max);
+        } else if (arg.rfind("--max-scan=", 0) == 0) {
+            ycsb.max_scan_length = max(1, stoi(arg.substr(11)));
+        } else if (arg == "--no-load") {
+            ycsb.load = false;
+        } else if (arg == "--bulk-load") {
+            ycsb.bulk_load = true;
+        } else if (arg.rfind("--replay-file=", 0) == 0) {
+            replay_path = arg.substr(14);
+        } else if (arg.rfind("--replay-speed=", 0) == 0) {
+            replay_speed = stod(arg.substr(15));
+            if (replay_speed <= 0) {
+                cerr << "--replay-speed must be positive" << endl;
+                return 1;
+            }
+        } else if (arg.rfind("--engine=", 0) == 0) {
+            engine = arg.substr(9);
+            if (engine != "blocking" && engine != "epoll") {
+                cerr << "Unknown engine: " << engine << " (expected blocking or epoll)" << endl;
+                return 1;
+            }
+        } else if (arg.rfind("--connections=", 0) == 0) {
+            engine_connections = max(1, stoi(arg.substr(14)));
+        } else if (arg.rfind("--inflight=", 0) == 0) {
+            engine_inflight = max(1, stoi(arg.substr(11)));
+        } else if (arg.rfind("--write-method=", 0) == 0) {
+            string method = arg.substr(15);
+            if (method != "post" && method != "put") {
+                cerr << "Unknown write method: " << method << " (expected post or put)" << endl;
+                return 1;
+            }
+            raw_put = method == "put";
+        } else {
+            cerr << "Unknown flag: " << arg << endl;
+            return 1;
+        }
+    }
+
     function<void(const std::string&, int, int, int)> task_function;
 
     if (workload_type == "put_all") {
@@ -141,32 +1288,109 @@ int main(int argc, char** argv) {
     } else if (workload_type == "get_popular") {
         warmup(host, port);
         task_function = get_popular_task;
+    } else if (workload_type.rfind("ycsb", 0) == 0) {
+        double total = ycsb.read + ycsb.update + ycsb.insert + ycsb.del + ycsb.scan + ycsb.rmw;
+        if (total <= 0) {
+            cerr << "YCSB operation mix is empty" << endl;
+            return 1;
+        }
+        for (double* ratio : {&ycsb.read, &ycsb.update, &ycsb.insert, &ycsb.del, &ycsb.scan, &ycsb.rmw}) *ratio /= total;
+        if (ycsb.load) ycsb_load(host, port, num_threads);
+        ycsb_next_insert = ycsb.record_count;
+        key_chooser = make_unique<KeyChooser>();
+        task_function = ycsb_task;
+    } else if (workload_type == "replay") {
+        if (engine != "blocking" || rate > 0 || !ramp_rates.empty()) {
+            cerr << "replay sets its own schedule and uses the blocking engine" << endl;
+            return 1;
+        }
+        int64_t span_us = load_replay(replay_path, num_threads);
+        if (span_us < 0) {
+            cerr << "Cannot read replay file: " << replay_path << endl;
+            return 1;
+        }
+        // Duration 0 replays the whole capture.
+        if (duration_seconds <= 0) duration_seconds = (int)ceil(span_us / 1e6 / replay_speed) + 1;
+        task_function = replay_task;
+    } else {
+        cerr << "Unknown workload: " << workload_type << endl;
+        return 1;
+    }
+
+    if (engine == "epoll") {
+        if (ycsb.rmw > 0) {
+            cerr << "The epoll engine only issues single-request operations (no rmw)" << endl;
+            return 1;
+        }
+        active_workload = workload_type;
+        task_function = epoll_task;
     }
 
+    // A ramp replaces the positional duration: one step_seconds window per offered rate.
+    if (!ramp_rates.empty()) {
+        duration_seconds = ramp_rates.size() * step_seconds;
+        rate = ramp_rates[0];
+    }
+    total_threads = num_threads;
+    target_rate = rate;
+
     thread monitor(monitor_performance);
     vector<thread> threads;
-    
+
     auto start_clock = chrono::steady_clock::now();
+    replay_start = start_clock;
 
     for (int i = 0; i < num_threads; i++) {
         threads.emplace_back(task_function, host, port, duration_seconds, i);
     }
 
+    // Step through the ramp and find the knee: the highest offered rate that was still
+    // delivered (>= 95% achieved) without errors.
+    stringstream ramp_json;
+    double knee_rate = 0;
+    bool saturated = false;
+    if (!ramp_rates.empty()) {
+        StatsSnapshot step_start = collect_stats();
+        ramp_json << "[";
+        for (size_t i = 0; i < ramp_rates.size(); ++i) {
+            target_rate = ramp_rates[i];
+            this_thread::sleep_until(start_clock + chrono::seconds(step_seconds * (i + 1)));
+            StatsSnapshot now = collect_stats();
+            StatsSnapshot step = now.since(step_start);
+            step_start = now;
+
+            LatencyHistogram::Snapshot ok = step.completed();
+            double achieved = (double)ok.total / step_seconds;
+            bool delivered = achieved >= 0.95 * ramp_rates[i] && step.failed() == 0;
+            if (!delivered) saturated = true;
+            if (!saturated) knee_rate = ramp_rates[i];
+
+            cout << "[RAMP] offered=" << fixed << setprecision(0) << ramp_rates[i] << " achieved=" << achieved
+                 << setprecision(1) << " p50_us=" << ok.percentile_ns(0.50) / 1e3 << " p99_us=" << ok.percentile_ns(0.99) / 1e3
+                 << " service_p99_us=" << step.service.percentile_ns(0.99) / 1e3 << " failed=" << step.failed() << endl;
+            ramp_json << (i ? "," : "") << fixed << setprecision(1) << "{\"offered\":" << ramp_rates[i] << ",\"achieved\":" << achieved
+                      << ",\"failed\":" << step.failed() << ",\"latency\":" << latency_json(ok)
+                      << ",\"service_latency\":" << latency_json(step.service) << "}";
+        }
+        ramp_json << "]";
+    }
+
     for (auto& t : threads) t.join();
-    
+
     auto end_clock = chrono::steady_clock::now();
-    
+
     test_running = false;
     monitor.join();
 
     auto duration_ms = chrono::duration_cast<chrono::milliseconds>(end_clock - start_clock).count();
     double duration_s = duration_ms / 1000.0;
-    long long total_reqs = total_requests_completed.load();
-    long long total_time = total_response_time_ms.load();
-    long long total_fails = total_requests_failed.load();
-    
+    StatsSnapshot final_stats = collect_stats();
+    LatencyHistogram::Snapshot ok = final_stats.completed();
+    long long total_reqs = ok.total;
+    long long total_fails = final_stats.failed();
+
     double avg_throughput = (duration_s > 0) ? total_reqs / duration_s : 0.0;
-    double avg_latency = (total_reqs > 0) ? (double)total_time / total_reqs : 0.0;
+    double avg_latency = (total_reqs > 0) ? ok.sum_ns / 1e6 / total_reqs : 0.0;
 
     cout << "\n========================================" << endl;
     cout << "Final Benchmark Results" << endl;
@@ -174,9 +1398,50 @@ int main(int argc, char** argv) {
     cout << "Duration           : " << duration_s << " s" << endl;
     cout << "Total Requests     : " << total_reqs << endl;
     cout << "Total Failed       : " << total_fails << endl;
+    if (engine == "epoll") {
+        cout << "Connection Errors  : " << connection_errors.load() << endl;
+    }
     cout << "Average Throughput : " << fixed << setprecision(2) << avg_throughput << " req/s" << endl;
     cout << "Average Latency    : " << fixed << setprecision(2) << avg_latency << " ms" << endl;
+    cout << "p50 / p90 Latency  : " << ok.percentile_ns(0.50) / 1e3 << " / " << ok.percentile_ns(0.90) / 1e3 << " us" << endl;
+    cout << "p99 / p99.9 Latency: " << ok.percentile_ns(0.99) / 1e3 << " / " << ok.percentile_ns(0.999) / 1e3 << " us" << endl;
+    cout << "Max Latency        : " << ok.max_ns / 1e3 << " us" << endl;
+    if (rate > 0) {
+        cout << "Offered Rate       : " << (ramp_rates.empty() ? rate : ramp_rates.back()) << " req/s"
+             << (ramp_rates.empty() ? "" : " (ramp end)") << endl;
+        cout << "Service p99        : " << final_stats.service.percentile_ns(0.99) / 1e3 << " us (excludes queueing)" << endl;
+    }
+    if (!ramp_rates.empty()) {
+        cout << "Knee Rate          : " << knee_rate << " req/s" << endl;
+    }
     cout << "========================================" << endl;
 
+    stringstream result;
+    result << "{\"workload\":\"" << workload_type << "\",\"engine\":\"" << engine << "\",\"threads\":" << num_threads
+           << ",\"duration_s\":" << duration_s << ",\"throughput\":" << avg_throughput
+           << ",\"total_ok\":" << total_reqs << ",\"total_failed\":" << total_fails
+           << ",\"latency\":" << latency_json(ok) << ",\"ops\":" << ops_json(final_stats);
+    if (engine == "epoll") {
+        result << ",\"connections\":" << engine_connections << ",\"inflight\":" << engine_inflight
+               << ",\"connection_errors\":" << connection_errors.load();
+    }
+    if (workload_type.rfind("ycsb", 0) == 0) {
+        result << ",\"ycsb\":{\"read\":" << ycsb.read << ",\"update\":" << ycsb.update << ",\"insert\":" << ycsb.insert
+               << ",\"delete\":" << ycsb.del << ",\"scan\":" << ycsb.scan << ",\"rmw\":" << ycsb.rmw
+               << ",\"dist\":\"" << ycsb.dist << "\",\"theta\":" << ycsb.theta << ",\"keys\":" << ycsb.record_count
+               << ",\"value_min\":" << ycsb.value_min << ",\"value_max\":" << ycsb.value_max << "}";
+    }
+    if (rate > 0) {
+        result << ",\"target_rate\":" << rate << ",\"service_latency\":" << latency_json(final_stats.service);
+    }
+    if (!ramp_rates.empty()) {
+        result << ",\"knee_rate\":" << knee_rate << ",\"ramp\":" << ramp_json.str();
+    }
+    result << "}";
+    cout << "[RESULT_JSON] " << result.str() << endl;
+    if (!json_out.empty()) {
+        ofstream(json_out) << result.str() << endl;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
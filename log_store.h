@@ -0,0 +1,531 @@
+#pragma once
+
+#include "storage_backend.h"
+#include "metrics.h"
+
+struct LogStoreConfig {
+    string data_dir = "kv_data";
+    bool sync_writes = true;
+    uint64_t max_file_bytes = 64ull << 20;
+    double merge_garbage_ratio = 0.5;
+    uint64_t merge_min_bytes = 16ull << 20;
+};
+
+// Bitcask-style embedded engine: every write is appended to the active data file and
+// an in-memory key directory maps each live key to the file/offset of its latest value,
+// so a read is one hash lookup plus one pread. Files are rotated at max_file_bytes and
+// a background merge rewrites the immutable ones once enough of them is garbage.
+//
+// Record layout: crc32 | key_len | value_len | type | key | value (crc covers the rest).
+class LogStructuredStore : public StorageBackend {
+public:
+    explicit LogStructuredStore(const LogStoreConfig& config) : config_(config) {
+        filesystem::create_directories(config_.data_dir);
+        recover();
+        merge_thread_ = thread(&LogStructuredStore::merge_loop, this);
+        cout << "[LOGSTORE] Opened " << config_.data_dir << " with " << keydir_.size()
+             << " keys in " << fds_.size() << " files." << endl;
+    }
+
+    ~LogStructuredStore() {
+        {
+            lock_guard<mutex> lock(merge_mutex_);
+            stop_flag_ = true;
+        }
+        merge_cv_.notify_one();
+        if (merge_thread_.joinable()) {
+            merge_thread_.join();
+        }
+        fdatasync(active_fd_);
+        for (auto& [id, fd] : fds_) close(fd);
+    }
+
+    void create(const string& key, const string& value) override {
+        string buf;
+        encode_record(buf, Put, key, value);
+        commit(buf, {{&key, Put, buf.size(), value.size()}});
+    }
+
+    string read(const string& key) override {
+        shared_lock<shared_mutex> lock(keydir_mutex_);
+        auto it = keydir_.find(key);
+        if (it == keydir_.end()) return "";
+
+        const Location& loc = it->second;
+        string value(loc.value_len, '\0');
+        if (!pread_all(fds_.at(loc.file_id), &value[0], loc.value_len, loc.value_offset)) {
+            cerr << "[LOGSTORE] Short read for key " << key << endl;
+            return "";
+        }
+        return value;
+    }
+
+    void del(const string& key) override {
+        string buf;
+        encode_record(buf, Delete, key, "");
+        commit(buf, {{&key, Delete, buf.size(), 0}});
+    }
+
+    void batch(const vector<WriteOp>& ops) override {
+        string buf;
+        vector<PendingRecord> records;
+        records.reserve(ops.size());
+        for (const auto& op : ops) {
+            RecordType type = op.type == WriteOp::Put ? Put : Delete;
+            const string& value = op.type == WriteOp::Put ? op.value : string();
+            size_t before = buf.size();
+            encode_record(buf, type, op.key, value);
+            records.push_back({&op.key, type, buf.size() - before, value.size()});
+        }
+        commit(buf, records);
+    }
+
+    // Collects the matching keys up front, then reads values a batch at a time so the
+    // keydir lock is never held across a pread.
+    bool scan(const string& prefix, size_t batch_size,
+              const function<bool(vector<pair<string, string>>&)>& fn) override {
+        vector<string> keys;
+        {
+            shared_lock<shared_mutex> lock(keydir_mutex_);
+            for (const auto& [key, loc] : keydir_) {
+                if (key.compare(0, prefix.size(), prefix) == 0) keys.push_back(key);
+            }
+        }
+        vector<pair<string, string>> batch;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            string value = read(keys[i]);
+            if (!value.empty()) batch.emplace_back(move(keys[i]), move(value));
+            if (batch.size() >= batch_size || (i + 1 == keys.size() && !batch.empty())) {
+                if (!fn(batch)) break;
+                batch.clear();
+            }
+        }
+        return true;
+    }
+
+    void append_stats(ostream& out) override {
+        shared_lock<shared_mutex> lock(keydir_mutex_);
+        out << "logstore_keys " << keydir_.size() << "\n"
+            << "logstore_files " << fds_.size() << "\n"
+            << "logstore_bytes " << total_bytes_ << "\n"
+            << "logstore_garbage_bytes " << total_bytes_ - live_bytes_ << "\n"
+            << "logstore_merges_total " << merges_.load() << "\n";
+    }
+
+private:
+    enum RecordType : uint8_t { Put = 0, Delete = 1, MergeBarrier = 2 };
+    static constexpr size_t kHeaderSize = 13;
+
+    struct Location {
+        uint32_t file_id;
+        uint64_t value_offset;
+        uint32_t value_len;
+        uint32_t record_len;
+    };
+
+    struct PendingRecord {
+        const string* key;
+        RecordType type;
+        size_t record_len;
+        size_t value_len;
+    };
+
+    static void encode_record(string& buf, RecordType type, const string& key, const string& value) {
+        size_t start = buf.size();
+        uint32_t key_len = key.size(), value_len = value.size();
+        buf.resize(start + kHeaderSize);
+        memcpy(&buf[start + 4], &key_len, 4);
+        memcpy(&buf[start + 8], &value_len, 4);
+        buf[start + 12] = (char)type;
+        buf += key;
+        buf += value;
+        uint32_t crc = crc32(buf.data() + start + 4, buf.size() - start - 4);
+        memcpy(&buf[start], &crc, 4);
+    }
+
+    // Decodes the record at data[offset]; returns its length, or 0 if it is truncated or corrupt.
+    static size_t decode_record(const char* data, size_t size, size_t offset,
+                                RecordType& type, string_view& key, uint32_t& value_len) {
+        if (size - offset < kHeaderSize) return 0;
+        uint32_t crc, key_len;
+        memcpy(&crc, data + offset, 4);
+        memcpy(&key_len, data + offset + 4, 4);
+        memcpy(&value_len, data + offset + 8, 4);
+        uint64_t len = kHeaderSize + (uint64_t)key_len + value_len;
+        if (len > size - offset) return 0;
+        if (crc32(data + offset + 4, len - 4) != crc) return 0;
+        type = (RecordType)data[offset + 12];
+        key = string_view(data + offset + kHeaderSize, key_len);
+        return len;
+    }
+
+    static bool pread_all(int fd, char* dst, size_t len, uint64_t offset) {
+        while (len > 0) {
+            ssize_t n = pread(fd, dst, len, offset);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                return false;
+            }
+            dst += n;
+            len -= n;
+            offset += n;
+        }
+        return true;
+    }
+
+    static bool write_all(int fd, const char* src, size_t len) {
+        while (len > 0) {
+            ssize_t n = write(fd, src, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            src += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    string file_path(uint32_t id) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%08u.data", id);
+        return (filesystem::path(config_.data_dir) / name).string();
+    }
+
+    // Caller holds keydir_mutex_ exclusively.
+    void apply(const string& key, RecordType type, const Location& loc) {
+        if (type == Put) {
+            auto [it, inserted] = keydir_.try_emplace(key, loc);
+            if (!inserted) {
+                live_bytes_ -= it->second.record_len;
+                it->second = loc;
+            }
+            live_bytes_ += loc.record_len;
+        } else {
+            auto it = keydir_.find(key);
+            if (it != keydir_.end()) {
+                live_bytes_ -= it->second.record_len;
+                keydir_.erase(it);
+            }
+        }
+        total_bytes_ += loc.record_len;
+    }
+
+    void commit(const string& buf, const vector<PendingRecord>& records) {
+        uint64_t seq;
+        {
+            lock_guard<mutex> lock(write_mutex_);
+            if (active_offset_ > 0 && active_offset_ + buf.size() > config_.max_file_bytes) {
+                rotate();
+            }
+            if (!write_all(active_fd_, buf.data(), buf.size())) {
+                string error = strerror(errno);
+                // Cut off whatever part of buf did land, so the next append (O_APPEND) starts
+                // at active_offset_ instead of behind a torn record. If the file cannot be
+                // cut, its tail is garbage until recovery truncates it; move on to a new file.
+                if (ftruncate(active_fd_, active_offset_) != 0) {
+                    off_t size = lseek(active_fd_, 0, SEEK_END);
+                    if (size > 0 && (uint64_t)size > active_offset_) {
+                        unique_lock<shared_mutex> keydir_lock(keydir_mutex_);
+                        total_bytes_ += size - active_offset_;
+                    }
+                    rotate();
+                }
+                throw runtime_error("log store write failed: " + error);
+            }
+
+            unique_lock<shared_mutex> keydir_lock(keydir_mutex_);
+            uint64_t offset = active_offset_;
+            for (const auto& rec : records) {
+                Location loc{active_id_, offset + kHeaderSize + rec.key->size(),
+                             (uint32_t)rec.value_len, (uint32_t)rec.record_len};
+                apply(*rec.key, rec.type, loc);
+                offset += rec.record_len;
+            }
+            active_offset_ = offset;
+            seq = ++write_seq_;
+        }
+        if (config_.sync_writes) {
+            sync_through(seq);
+        }
+    }
+
+    // Group commit: one fdatasync covers every write appended before it started,
+    // so concurrent writers waiting here mostly find their record already durable.
+    void sync_through(uint64_t seq) {
+        lock_guard<mutex> lock(sync_mutex_);
+        if (synced_seq_ >= seq) return;
+
+        uint64_t target;
+        int fd;
+        {
+            lock_guard<mutex> write_lock(write_mutex_);
+            target = write_seq_;
+            fd = active_fd_;
+        }
+        fdatasync(fd);
+        synced_seq_ = target;
+    }
+
+    // Caller holds write_mutex_.
+    void rotate() {
+        fdatasync(active_fd_);
+        uint32_t id = active_id_ + 1;
+        int fd = open(file_path(id).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd == -1) {
+            throw runtime_error("log store cannot create " + file_path(id) + ": " + strerror(errno));
+        }
+        unique_lock<shared_mutex> keydir_lock(keydir_mutex_);
+        fds_[id] = fd;
+        active_id_ = id;
+        active_fd_ = fd;
+        active_offset_ = 0;
+    }
+
+    bool starts_with_barrier(uint32_t id) const {
+        int fd = open(file_path(id).c_str(), O_RDONLY);
+        if (fd == -1) return false;
+        char header[kHeaderSize];
+        bool barrier = pread_all(fd, header, kHeaderSize, 0) && header[12] == (char)MergeBarrier;
+        close(fd);
+        return barrier;
+    }
+
+    void recover() {
+        vector<uint32_t> ids;
+        for (const auto& entry : filesystem::directory_iterator(config_.data_dir)) {
+            if (entry.path().extension() == ".merge") {
+                filesystem::remove(entry.path());
+            } else if (entry.path().extension() == ".data") {
+                string stem = entry.path().stem().string();
+                uint32_t id;
+                auto [end, ec] = from_chars(stem.data(), stem.data() + stem.size(), id);
+                if (stem.empty() || ec != errc() || end != stem.data() + stem.size()) {
+                    cerr << "[LOGSTORE] Ignoring " << entry.path() << ": not a data file name" << endl;
+                    continue;
+                }
+                ids.push_back(id);
+            }
+        }
+        sort(ids.begin(), ids.end());
+
+        // A merged file supersedes every older file; those are leftovers of an interrupted merge.
+        for (size_t i = ids.size(); i-- > 0;) {
+            if (starts_with_barrier(ids[i])) {
+                for (size_t j = 0; j < i; ++j) filesystem::remove(file_path(ids[j]));
+                ids.erase(ids.begin(), ids.begin() + i);
+                break;
+            }
+        }
+
+        for (uint32_t id : ids) {
+            int fd = open(file_path(id).c_str(), O_RDWR | O_APPEND);
+            if (fd == -1) {
+                throw runtime_error("log store cannot open " + file_path(id) + ": " + strerror(errno));
+            }
+            uint64_t size = lseek(fd, 0, SEEK_END);
+            uint64_t valid = 0;
+            if (size > 0) {
+                void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map == MAP_FAILED) {
+                    throw runtime_error("log store cannot map " + file_path(id));
+                }
+                const char* data = (const char*)map;
+                madvise(map, size, MADV_SEQUENTIAL);
+                while (valid < size) {
+                    RecordType type;
+                    string_view key;
+                    uint32_t value_len;
+                    size_t len = decode_record(data, size, valid, type, key, value_len);
+                    if (len == 0) break;
+                    Location loc{id, valid + kHeaderSize + key.size(), value_len, (uint32_t)len};
+                    if (type == MergeBarrier) {
+                        total_bytes_ += len;
+                    } else {
+                        apply(string(key), type, loc);
+                    }
+                    valid += len;
+                }
+                munmap(map, size);
+            }
+
+            if (valid < size) {
+                cerr << "[LOGSTORE] Truncating " << (size - valid) << " corrupt/partial bytes from "
+                     << file_path(id) << endl;
+                if (ftruncate(fd, valid) != 0) {
+                    throw runtime_error("log store cannot truncate " + file_path(id));
+                }
+            }
+            fds_[id] = fd;
+            active_id_ = id;
+            active_fd_ = fd;
+            active_offset_ = valid;
+        }
+
+        if (fds_.empty()) {
+            active_id_ = 1;
+            active_fd_ = open(file_path(active_id_).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+            if (active_fd_ == -1) {
+                throw runtime_error("log store cannot create " + file_path(active_id_) + ": " + strerror(errno));
+            }
+            fds_[active_id_] = active_fd_;
+            active_offset_ = 0;
+        }
+    }
+
+    void merge_loop() {
+        unique_lock<mutex> lock(merge_mutex_);
+        while (!stop_flag_) {
+            merge_cv_.wait_for(lock, chrono::seconds(5), [this] { return stop_flag_; });
+            if (stop_flag_) break;
+
+            bool needed;
+            {
+                shared_lock<shared_mutex> keydir_lock(keydir_mutex_);
+                needed = fds_.size() > 1 && total_bytes_ >= config_.merge_min_bytes &&
+                         total_bytes_ - live_bytes_ >= config_.merge_garbage_ratio * total_bytes_;
+            }
+            if (needed) {
+                lock.unlock();
+                merge();
+                lock.lock();
+            }
+        }
+    }
+
+    // Rewrites the live records of all immutable files into one file that takes the id of
+    // the newest of them. The file starts with a barrier record, so if we crash before the
+    // older files are unlinked, recovery discards them instead of resurrecting deleted keys.
+    void merge() {
+        uint32_t active_id;
+        {
+            lock_guard<mutex> lock(write_mutex_);
+            active_id = active_id_;
+        }
+        vector<pair<uint32_t, int>> inputs;
+        {
+            shared_lock<shared_mutex> keydir_lock(keydir_mutex_);
+            for (auto& [id, fd] : fds_) {
+                if (id < active_id) inputs.emplace_back(id, fd);
+            }
+        }
+        if (inputs.empty()) return;
+
+        uint32_t out_id = inputs.back().first;
+        string tmp_path = file_path(out_id) + ".merge";
+        int out = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (out == -1) {
+            cerr << "[LOGSTORE] Merge failed to create " << tmp_path << endl;
+            return;
+        }
+
+        struct Moved {
+            string key;
+            Location from, to;
+        };
+        vector<Moved> moved;
+        string buf;
+        encode_record(buf, MergeBarrier, "", "");
+        uint64_t out_offset = 0, input_bytes = 0;
+        bool ok = true;
+
+        for (auto& [id, fd] : inputs) {
+            uint64_t size = lseek(fd, 0, SEEK_END);
+            input_bytes += size;
+            if (size == 0) continue;
+            void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                ok = false;
+                break;
+            }
+            const char* data = (const char*)map;
+            uint64_t offset = 0;
+            while (offset < size) {
+                RecordType type;
+                string_view key;
+                uint32_t value_len;
+                size_t len = decode_record(data, size, offset, type, key, value_len);
+                if (len == 0) break;
+                if (type == Put) {
+                    Location from{id, offset + kHeaderSize + key.size(), value_len, (uint32_t)len};
+                    bool live;
+                    {
+                        shared_lock<shared_mutex> keydir_lock(keydir_mutex_);
+                        auto it = keydir_.find(string(key));
+                        live = it != keydir_.end() && it->second.file_id == id &&
+                               it->second.value_offset == from.value_offset;
+                    }
+                    if (live) {
+                        Location to{out_id, out_offset + buf.size() + kHeaderSize + key.size(), value_len, (uint32_t)len};
+                        buf.append(data + offset, len);
+                        moved.push_back({string(key), from, to});
+                    }
+                }
+                offset += len;
+                if (buf.size() >= (1u << 20)) {
+                    ok = ok && write_all(out, buf.data(), buf.size());
+                    out_offset += buf.size();
+                    buf.clear();
+                }
+            }
+            munmap(map, size);
+        }
+        ok = ok && write_all(out, buf.data(), buf.size());
+        out_offset += buf.size();
+        ok = ok && fdatasync(out) == 0;
+        if (!ok || rename(tmp_path.c_str(), file_path(out_id).c_str()) != 0) {
+            cerr << "[LOGSTORE] Merge of " << inputs.size() << " files failed" << endl;
+            close(out);
+            filesystem::remove(tmp_path);
+            return;
+        }
+
+        {
+            unique_lock<shared_mutex> keydir_lock(keydir_mutex_);
+            for (const auto& m : moved) {
+                auto it = keydir_.find(m.key);
+                if (it != keydir_.end() && it->second.file_id == m.from.file_id &&
+                    it->second.value_offset == m.from.value_offset) {
+                    it->second = m.to;
+                }
+            }
+            for (auto& [id, fd] : inputs) {
+                close(fd);
+                fds_.erase(id);
+            }
+            fds_[out_id] = out;
+            total_bytes_ = total_bytes_ - input_bytes + out_offset;
+        }
+        for (auto& [id, fd] : inputs) {
+            if (id != out_id) filesystem::remove(file_path(id));
+        }
+        merges_++;
+        cout << "[LOGSTORE] Merged " << inputs.size() << " files (" << input_bytes << " -> "
+             << out_offset << " bytes)" << endl;
+    }
+
+    LogStoreConfig config_;
+
+    unordered_map<string, Location> keydir_;
+    map<uint32_t, int> fds_;
+    // Garbage is total_bytes_ - live_bytes_. live_bytes_ is the sum of record_len over the
+    // keydir, kept in step with it, so overwrites of merged records cannot make it drift.
+    uint64_t total_bytes_ = 0;
+    uint64_t live_bytes_ = 0;
+    shared_mutex keydir_mutex_;
+
+    mutex write_mutex_;
+    uint32_t active_id_ = 0;
+    int active_fd_ = -1;
+    uint64_t active_offset_ = 0;
+    uint64_t write_seq_ = 0;
+
+    mutex sync_mutex_;
+    uint64_t synced_seq_ = 0;
+
+    mutex merge_mutex_;
+    condition_variable merge_cv_;
+    bool stop_flag_ = false;
+    thread merge_thread_;
+    atomic<long long> merges_{0};
+};
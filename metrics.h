@@ -0,0 +1,454 @@
+#pragma once
+
+#include "kv_common.h"
+
+// Metrics are recorded into per-thread slot blocks: each thread only ever writes its own
+// block (plain relaxed load/store, no locked instructions or shared cache lines), and a
+// scrape sums the slot across all blocks. Blocks are split into pages allocated on first
+// write, so a thread only pays memory for the metrics it touches. Blocks are never freed
+// so counts from exited threads survive. Metrics give their slots back when destroyed;
+// released ranges are zeroed and reused by the next allocation of the same size.
+class MetricsRegistry {
+public:
+    static constexpr size_t kPageBits = 10;
+    static constexpr size_t kPageSize = 1 << kPageBits;
+    static constexpr size_t kMaxPages = 1024;
+
+    // Never destroyed: metrics and locks in other statics release into it during exit.
+    static MetricsRegistry& instance() {
+        static MetricsRegistry* registry = new MetricsRegistry();
+        return *registry;
+    }
+
+    size_t allocate(size_t slots) {
+        lock_guard<mutex> lock(mutex_);
+        auto& reusable = free_[slots];
+        if (!reusable.empty()) {
+            size_t base = reusable.back();
+            reusable.pop_back();
+            return base;
+        }
+        // Keep a metric inside one page unless it is bigger than a page.
+        size_t offset = next_slot_ & (kPageSize - 1);
+        if (slots <= kPageSize && offset + slots > kPageSize) {
+            next_slot_ += kPageSize - offset;
+        }
+        if (next_slot_ + slots > kMaxPages * kPageSize) {
+            throw runtime_error("metrics registry out of slots");
+        }
+        size_t base = next_slot_;
+        next_slot_ += slots;
+        return base;
+    }
+
+    // The owner must be done recording; every thread's copy of the range is cleared so the
+    // next user starts from zero.
+    void release(size_t base, size_t slots) {
+        lock_guard<mutex> lock(mutex_);
+        for (const auto& block : blocks_) {
+            for (size_t slot = base; slot < base + slots; ++slot) {
+                Page* p = block->pages[slot >> kPageBits].load(memory_order_acquire);
+                if (p) p->slots[slot & (kPageSize - 1)].store(0, memory_order_relaxed);
+            }
+        }
+        free_[slots].push_back(base);
+    }
+
+    void add(size_t slot, uint64_t delta) {
+        static thread_local ThreadBlock* block = register_thread();
+        auto& page = block->pages[slot >> kPageBits];
+        Page* p = page.load(memory_order_relaxed);
+        if (!p) {
+            p = new Page();
+            page.store(p, memory_order_release);
+        }
+        auto& s = p->slots[slot & (kPageSize - 1)];
+        s.store(s.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+
+    uint64_t sum(size_t slot) {
+        return sum_range(slot, 1)[0];
+    }
+
+    vector<uint64_t> sum_range(size_t base, size_t count) {
+        lock_guard<mutex> lock(mutex_);
+        vector<uint64_t> totals(count, 0);
+        for (const auto& block : blocks_) {
+            for (size_t i = 0; i < count; ++i) {
+                size_t slot = base + i;
+                Page* p = block->pages[slot >> kPageBits].load(memory_order_acquire);
+                if (p) totals[i] += p->slots[slot & (kPageSize - 1)].load(memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+
+private:
+    struct Page {
+        array<atomic<uint64_t>, kPageSize> slots{};
+    };
+
+    struct ThreadBlock {
+        array<atomic<Page*>, kMaxPages> pages{};
+    };
+
+    ThreadBlock* register_thread() {
+        lock_guard<mutex> lock(mutex_);
+        blocks_.push_back(make_unique<ThreadBlock>());
+        return blocks_.back().get();
+    }
+
+    mutex mutex_;
+    size_t next_slot_ = 0;
+    vector<unique_ptr<ThreadBlock>> blocks_;
+    unordered_map<size_t, vector<size_t>> free_;   // released bases by range size
+};
+
+class Counter {
+public:
+    Counter() : slot_(MetricsRegistry::instance().allocate(1)) {}
+
+    ~Counter() {
+        MetricsRegistry::instance().release(slot_, 1);
+    }
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void inc(uint64_t n = 1) {
+        MetricsRegistry::instance().add(slot_, n);
+    }
+
+    uint64_t value() const {
+        return MetricsRegistry::instance().sum(slot_);
+    }
+
+private:
+    size_t slot_;
+};
+
+// A sampled request: stage spans are appended by ScopedTimer while the handler runs on
+// this thread, and the finished trace lands in the thread's ring for /debug/traces.
+struct RequestTrace {
+    struct Span {
+        const char* stage;
+        uint64_t offset_ns;
+        uint64_t duration_ns;
+    };
+    static constexpr size_t kMaxSpans = 16;
+
+    string route;
+    string key;
+    int status = 0;
+    size_t thread_index = 0;
+    chrono::steady_clock::time_point start;
+    chrono::system_clock::time_point wall_start;
+    uint64_t total_ns = 0;
+    array<Span, kMaxSpans> spans;
+    size_t span_count = 0;
+
+    void add_span(const char* stage, chrono::steady_clock::time_point from, chrono::steady_clock::time_point to) {
+        if (span_count == kMaxSpans) return;
+        spans[span_count++] = {stage, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(from - start).count(),
+                               (uint64_t)chrono::duration_cast<chrono::nanoseconds>(to - from).count()};
+    }
+};
+
+inline thread_local RequestTrace* current_trace = nullptr;
+
+class TraceRegistry {
+public:
+    static constexpr size_t kRingSize = 256;
+
+    static TraceRegistry& instance() {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    // 1 in every sample_every requests is traced; 0 disables tracing.
+    void set_sample_every(uint32_t n) {
+        sample_every_ = n;
+    }
+
+    bool should_sample() {
+        static thread_local uint32_t counter = 0;
+        uint32_t every = sample_every_.load(memory_order_relaxed);
+        return every != 0 && ++counter % every == 0;
+    }
+
+    void publish(RequestTrace&& trace) {
+        static thread_local Ring* ring = register_thread();
+        trace.thread_index = ring->index;
+        lock_guard<mutex> lock(ring->mtx);
+        ring->traces[ring->next++ % kRingSize] = move(trace);
+    }
+
+    // Slowest traces currently held in any ring, slowest first.
+    vector<RequestTrace> slowest(size_t limit) {
+        vector<RequestTrace> all;
+        {
+            lock_guard<mutex> lock(mutex_);
+            for (auto& ring : rings_) {
+                lock_guard<mutex> ring_lock(ring->mtx);
+                size_t n = min<size_t>(ring->next, kRingSize);
+                all.insert(all.end(), ring->traces.begin(), ring->traces.begin() + n);
+            }
+        }
+        size_t keep = min(limit, all.size());
+        partial_sort(all.begin(), all.begin() + keep, all.end(),
+                     [](const RequestTrace& a, const RequestTrace& b) { return a.total_ns > b.total_ns; });
+        all.resize(keep);
+        return all;
+    }
+
+private:
+    struct Ring {
+        mutex mtx;
+        size_t index;
+        uint64_t next = 0;
+        array<RequestTrace, kRingSize> traces;
+    };
+
+    Ring* register_thread() {
+        lock_guard<mutex> lock(mutex_);
+        rings_.push_back(make_unique<Ring>());
+        rings_.back()->index = rings_.size();
+        return rings_.back().get();
+    }
+
+    atomic<uint32_t> sample_every_{100};
+    mutex mutex_;
+    vector<unique_ptr<Ring>> rings_;
+};
+
+inline string traces_to_json(const vector<RequestTrace>& traces) {
+    stringstream out;
+    out << "[";
+    for (size_t i = 0; i < traces.size(); ++i) {
+        const auto& t = traces[i];
+        auto wall_us = chrono::duration_cast<chrono::microseconds>(t.wall_start.time_since_epoch()).count();
+        out << (i ? ",\n" : "\n") << "{\"route\":\"" << json_escape(t.route) << "\",\"key\":\"" << json_escape(t.key)
+            << "\",\"status\":" << t.status << ",\"start_unix_us\":" << wall_us
+            << ",\"total_us\":" << t.total_ns / 1000.0 << ",\"stages\":[";
+        for (size_t s = 0; s < t.span_count; ++s) {
+            out << (s ? "," : "") << "{\"stage\":\"" << t.spans[s].stage << "\",\"offset_us\":"
+                << t.spans[s].offset_ns / 1000.0 << ",\"duration_us\":" << t.spans[s].duration_ns / 1000.0 << "}";
+        }
+        out << "]}";
+    }
+    out << "\n]\n";
+    return out.str();
+}
+
+// Chrome trace-event format (chrome://tracing, Perfetto): one complete event per request
+// with its stages nested underneath on the same thread track.
+inline string traces_to_chrome(const vector<RequestTrace>& traces) {
+    stringstream out;
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    auto event = [&](const string& name, double ts_us, double dur_us, size_t tid, const string& args) {
+        out << (first ? "\n" : ",\n") << "{\"name\":\"" << json_escape(name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+            << ",\"ts\":" << fixed << setprecision(3) << ts_us << ",\"dur\":" << dur_us << ",\"args\":{" << args << "}}";
+        first = false;
+    };
+    for (const auto& t : traces) {
+        double start_us = chrono::duration_cast<chrono::nanoseconds>(t.wall_start.time_since_epoch()).count() / 1000.0;
+        event(t.route, start_us, t.total_ns / 1000.0, t.thread_index,
+              "\"key\":\"" + json_escape(t.key) + "\",\"status\":" + to_string(t.status));
+        for (size_t s = 0; s < t.span_count; ++s) {
+            event(t.spans[s].stage, start_us + t.spans[s].offset_ns / 1000.0, t.spans[s].duration_ns / 1000.0,
+                  t.thread_index, "");
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+// HDR-style log-linear histogram of nanosecond values: 8 linear sub-buckets per power of
+// two keeps relative error under 12.5% from 1 ns up to the ~18 minute clamp.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr size_t kSub = 1 << kSubBits;
+    static constexpr int kMaxBits = 40;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) * kSub;
+
+    struct Snapshot {
+        vector<uint64_t> counts;
+        uint64_t count = 0;
+        uint64_t sum_ns = 0;
+
+        // Upper bound of the bucket holding the q-th quantile (0 <= q <= 1).
+        uint64_t quantile_ns(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(q * count));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); ++i) {
+                seen += counts[i];
+                if (seen >= rank) return bucket_upper_ns(i);
+            }
+            return bucket_upper_ns(counts.size() - 1);
+        }
+    };
+
+    // Named histograms also show up as spans in sampled request traces.
+    explicit LatencyHistogram(const char* name = nullptr)
+        : name_(name), base_(MetricsRegistry::instance().allocate(kBuckets + 1)) {}
+
+    ~LatencyHistogram() {
+        MetricsRegistry::instance().release(base_, kBuckets + 1);
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    const char* name() const {
+        return name_;
+    }
+
+    void record_ns(uint64_t ns) {
+        auto& registry = MetricsRegistry::instance();
+        registry.add(base_ + bucket_index(ns), 1);
+        registry.add(base_ + kBuckets, ns);
+    }
+
+    void record(chrono::steady_clock::duration d) {
+        record_ns(max<int64_t>(0, chrono::duration_cast<chrono::nanoseconds>(d).count()));
+    }
+
+    void record_span(chrono::steady_clock::time_point from, chrono::steady_clock::time_point to) {
+        record(to - from);
+        if (current_trace && name_) {
+            current_trace->add_span(name_, from, to);
+        }
+    }
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        s.counts = MetricsRegistry::instance().sum_range(base_, kBuckets + 1);
+        s.sum_ns = s.counts.back();
+        s.counts.pop_back();
+        for (uint64_t c : s.counts) s.count += c;
+        return s;
+    }
+
+    static size_t bucket_index(uint64_t v) {
+        v = min<uint64_t>(v, (1ull << kMaxBits) - 1);
+        if (v < kSub) return v;
+        int msb = 63 - __builtin_clzll(v);
+        return (msb - kSubBits + 1) * kSub + ((v >> (msb - kSubBits)) & (kSub - 1));
+    }
+
+    static uint64_t bucket_upper_ns(size_t idx) {
+        if (idx < kSub) return idx + 1;
+        int shift = idx / kSub - 1;
+        uint64_t sub = idx % kSub;
+        return (kSub + sub + 1) << shift;
+    }
+
+private:
+    const char* name_;
+    size_t base_;
+};
+
+// Times the enclosing scope into a histogram.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& hist) : hist_(hist), start_(chrono::steady_clock::now()) {}
+    ~ScopedTimer() { hist_.record_span(start_, chrono::steady_clock::now()); }
+
+private:
+    LatencyHistogram& hist_;
+    chrono::steady_clock::time_point start_;
+};
+
+struct StageMetrics {
+    LatencyHistogram shard_lock_wait{"shard_lock_wait"};
+    LatencyHistogram cache_lookup{"cache_lookup"};
+    LatencyHistogram wal_enqueue{"wal_enqueue"};
+    LatencyHistogram wal_fsync{"wal_fsync"};
+    LatencyHistogram pool_wait{"pool_wait"};
+    LatencyHistogram db_execute{"db_execute"};
+    LatencyHistogram transform{"transform"};
+    LatencyHistogram compute_queue_wait{"compute_queue_wait"};
+
+    vector<const LatencyHistogram*> all() const {
+        return {&shard_lock_wait, &cache_lookup, &wal_enqueue, &wal_fsync, &pool_wait, &db_execute,
+                &transform, &compute_queue_wait};
+    }
+};
+
+inline StageMetrics& stage_metrics() {
+    static StageMetrics metrics;
+    return metrics;
+}
+
+struct RouteMetrics {
+    string route;
+    LatencyHistogram latency;
+    array<Counter, 4> responses;   // 2xx, 3xx, 4xx, 5xx
+
+    void record(int status, chrono::steady_clock::duration elapsed) {
+        latency.record(elapsed);
+        responses[min(max(status / 100 - 2, 0), 3)].inc();
+    }
+};
+
+class HttpMetrics {
+public:
+    static HttpMetrics& instance() {
+        static HttpMetrics metrics;
+        return metrics;
+    }
+
+    RouteMetrics& route(const string& name) {
+        lock_guard<mutex> lock(mutex_);
+        for (auto& r : routes_) {
+            if (r->route == name) return *r;
+        }
+        routes_.push_back(make_unique<RouteMetrics>());
+        routes_.back()->route = name;
+        return *routes_.back();
+    }
+
+    // Renders all route and stage metrics in the Prometheus text exposition format.
+    void render(ostream& out) {
+        lock_guard<mutex> lock(mutex_);
+        out << "# TYPE kv_http_requests_total counter\n";
+        static const char* classes[] = {"2xx", "3xx", "4xx", "5xx"};
+        for (auto& r : routes_) {
+            for (size_t i = 0; i < r->responses.size(); ++i) {
+                out << "kv_http_requests_total{route=\"" << r->route << "\",status=\"" << classes[i] << "\"} "
+                    << r->responses[i].value() << "\n";
+            }
+        }
+        out << "# TYPE kv_http_request_duration_seconds histogram\n";
+        for (auto& r : routes_) {
+            render_histogram(out, "kv_http_request_duration_seconds", "route=\"" + r->route + "\"", r->latency.snapshot());
+        }
+        out << "# TYPE kv_stage_duration_seconds histogram\n";
+        for (const auto* hist : stage_metrics().all()) {
+            render_histogram(out, "kv_stage_duration_seconds", "stage=\"" + string(hist->name()) + "\"", hist->snapshot());
+        }
+    }
+
+private:
+    // Exported at power-of-two boundaries from ~1 us to ~34 s; finer buckets stay internal.
+    static void render_histogram(ostream& out, const string& name, const string& labels,
+                                 const LatencyHistogram::Snapshot& s) {
+        uint64_t cumulative = 0;
+        size_t idx = 0;
+        for (int bits = 10; bits <= 35; ++bits) {
+            size_t limit = LatencyHistogram::bucket_index(1ull << bits);
+            for (; idx < limit; ++idx) cumulative += s.counts[idx];
+            out << name << "_bucket{" << labels << ",le=\"" << (double)(1ull << bits) / 1e9 << "\"} "
+                << cumulative << "\n";
+        }
+        out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << s.count << "\n"
+            << name << "_sum{" << labels << "} " << s.sum_ns / 1e9 << "\n"
+            << name << "_count{" << labels << "} " << s.count << "\n";
+    }
+
+    mutex mutex_;
+    vector<unique_ptr<RouteMetrics>> routes_;
+};
@@ -0,0 +1,288 @@
+#include <benchmark/benchmark.h>
+#include "kv_common.h"
+#include "metrics.h"
+#include "wal.h"
+#include "kv_cache.h"
+#include "value_transform.h"
+#include "near_cache.h"
+#include "hot_keys.h"
+#include <random>
+
+// In-process microbenchmarks for the cache, WAL and hashing components. They need no
+// MySQL and no HTTP, so a component regression shows up in seconds:
+//   ./microbench --benchmark_filter=Cache --benchmark_min_time=0.5
+
+namespace {
+
+const size_t kKeyspace = 100000;
+const size_t kSamples = 1 << 16;
+
+vector<string> make_keys(size_t n) {
+    vector<string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i) keys.push_back("user" + to_string(i));
+    return keys;
+}
+
+const vector<string>& keys() {
+    static const vector<string> k = make_keys(kKeyspace);
+    return k;
+}
+
+// Key indexes for one thread, drawn up front so sampling stays out of the timed loop.
+// theta == 0 is uniform; otherwise keys follow a zipfian law with that exponent.
+vector<uint32_t> key_sequence(double theta, uint64_t seed) {
+    mt19937_64 gen(seed);
+    vector<uint32_t> seq(kSamples);
+    if (theta == 0) {
+        uniform_int_distribution<uint32_t> dist(0, kKeyspace - 1);
+        for (auto& s : seq) s = dist(gen);
+        return seq;
+    }
+    vector<double> cdf(kKeyspace);
+    double sum = 0;
+    for (size_t i = 0; i < kKeyspace; ++i) cdf[i] = sum += 1.0 / pow(i + 1.0, theta);
+    uniform_real_distribution<double> u(0, sum);
+    for (auto& s : seq) s = lower_bound(cdf.begin(), cdf.end(), u(gen)) - cdf.begin();
+    return seq;
+}
+
+unique_ptr<ShardedKVCache> shared_cache;
+shared_ptr<ShardedKVCache> hot_cache;
+unique_ptr<NearCache> hot_near;
+unique_ptr<HotKeyTracker> tracker;
+
+}  // namespace
+
+// Args: shard count, read percentage, value bytes, zipf theta x100 (0 = uniform).
+static void BM_CacheMix(benchmark::State& state) {
+    size_t shards = state.range(0);
+    int read_pct = state.range(1);
+    string value(state.range(2), 'v');
+    double theta = state.range(3) / 100.0;
+
+    if (state.thread_index() == 0) {
+        shared_cache = make_unique<ShardedKVCache>(shards);
+        for (const auto& k : keys()) shared_cache->create(k, value);
+    }
+    auto seq = key_sequence(theta, 42 + state.thread_index());
+    mt19937 op_gen(7 + state.thread_index());
+    vector<bool> is_read(kSamples);
+    for (size_t i = 0; i < kSamples; ++i) is_read[i] = (int)(op_gen() % 100) < read_pct;
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const string& key = keys()[seq[i & (kSamples - 1)]];
+        if (is_read[i & (kSamples - 1)]) {
+            benchmark::DoNotOptimize(shared_cache->read(key));
+        } else {
+            shared_cache->create(key, value);
+        }
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) shared_cache.reset();
+}
+BENCHMARK(BM_CacheMix)
+    ->ArgNames({"shards", "read_pct", "value", "theta100"})
+    ->ArgsProduct({{1, 16, 64}, {95, 50}, {100}, {0, 99}})
+    ->Threads(1)->Threads(4)->Threads(8)
+    ->UseRealTime();
+BENCHMARK(BM_CacheMix)
+    ->ArgNames({"shards", "read_pct", "value", "theta100"})
+    ->ArgsProduct({{16}, {95}, {16, 1024, 16384}, {99}})
+    ->Threads(4)
+    ->UseRealTime();
+
+// Arg 1 selects the GET hit path: 0 transforms a copy on every read, 1 reads the
+// transform memoized in the entry.
+static void BM_CacheGetTransformed(benchmark::State& state) {
+    ShardedKVCache cache(16);
+    string value(state.range(0), 'v');
+    for (size_t k = 0; k < 1024; ++k) cache.create(keys()[k], value);
+    bool memoized = state.range(1);
+    size_t i = 0;
+    for (auto _ : state) {
+        const string& key = keys()[i++ & 1023];
+        if (memoized) {
+            benchmark::DoNotOptimize(cache.read_derived(key, perform_heavy_computation));
+        } else {
+            string v = cache.read(key);
+            perform_heavy_computation(v);
+            benchmark::DoNotOptimize(v);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CacheGetTransformed)
+    ->ArgNames({"value", "memoized"})
+    ->ArgsProduct({{100, 16384}, {0, 1}});
+
+// Arg: page size. Each iteration is one GET /kv page: the first `limit` keys after a random
+// start key, merged across the 16 shard indexes.
+static void BM_CacheScanPrefix(benchmark::State& state) {
+    ShardedKVCache cache(16, true);
+    for (const auto& k : keys()) cache.create(k, string(100, 'v'));
+    size_t limit = state.range(0);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.scan_prefix("user", keys()[(i++ * 7919) % kKeyspace], true, limit).items);
+    }
+    state.SetItemsProcessed(state.iterations() * limit);
+}
+BENCHMARK(BM_CacheScanPrefix)->Arg(10)->Arg(100)->Arg(1000);
+
+// get_popular in-process: every thread reads the same 100 keys. Arg 1 puts the per-thread
+// near-cache in front, so hot reads stop taking the shard locks.
+static void BM_NearCacheHot(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        hot_cache = make_shared<ShardedKVCache>(16);
+        for (size_t k = 0; k < 100; ++k) hot_cache->create(keys()[k], string(100, 'v'));
+        hot_near = state.range(0) ? make_unique<NearCache>(hot_cache, NearCache::Options()) : nullptr;
+    }
+    size_t i = state.thread_index() * 7;
+    for (auto _ : state) {
+        const string& key = keys()[i++ % 100];
+        auto fetch = [&] { return hot_cache->read_derived(key, perform_heavy_computation); };
+        benchmark::DoNotOptimize(hot_near ? hot_near->get(key, fetch) : fetch());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NearCacheHot)->ArgName("near")->Arg(0)->Arg(1)->Threads(1)->Threads(4)->Threads(8)->UseRealTime();
+
+// Per-access cost of HotKeyTracker::record on zipfian keys, with arg = sample_every.
+static void BM_HotKeyRecord(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        HotKeyTracker::Options options;
+        options.sample_every = state.range(0);
+        tracker = make_unique<HotKeyTracker>(make_shared<ShardedKVCache>(16), options);
+    }
+    auto seq = key_sequence(0.99, 11 + state.thread_index());
+    size_t i = 0;
+    for (auto _ : state) {
+        tracker->record(keys()[seq[i & (kSamples - 1)]], (i & 15) == 0);
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HotKeyRecord)->ArgName("sample")->Arg(1)->Arg(16)->Threads(1)->Threads(4)->UseRealTime();
+
+static void BM_CacheScanShard(benchmark::State& state) {
+    ShardedKVCache cache(16);
+    for (const auto& k : keys()) cache.create(k, "value");
+    size_t entries = 0;
+    for (auto _ : state) {
+        for (size_t s = 0; s < cache.shard_count(); ++s) {
+            cache.scan_shard(s, state.range(0), [&](vector<pair<string, string>>& batch) { entries += batch.size(); });
+        }
+    }
+    state.SetItemsProcessed(entries);
+}
+BENCHMARK(BM_CacheScanShard)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+// Fills an empty single-shard cache with the whole keyspace and reports the slowest single
+// insert, which is where a resize of the shard table would show up.
+static void BM_CacheGrowth(benchmark::State& state) {
+    double max_insert_us = 0;
+    for (auto _ : state) {
+        ShardedKVCache cache(1);
+        for (const auto& k : keys()) {
+            auto start = chrono::steady_clock::now();
+            cache.create(k, "value");
+            max_insert_us = max(max_insert_us, chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    state.counters["max_insert_us"] = max_insert_us;
+    state.SetItemsProcessed(state.iterations() * kKeyspace);
+}
+BENCHMARK(BM_CacheGrowth)->Unit(benchmark::kMillisecond);
+
+// Args: WAL batch limit, record bytes. Each iteration is one log() call; with the bounded
+// queue full, the enqueue rate settles at what the writer thread can write and fsync.
+static void BM_WalLog(benchmark::State& state) {
+    static unique_ptr<BoundedAsyncWALLogger> wal;
+    static string path;
+    string record;
+    BoundedAsyncWALLogger::append_record(record, "key", string(state.range(1), 'w'));
+    if (state.thread_index() == 0) {
+        path = (filesystem::temp_directory_path() / "kv_microbench_wal.log").string();
+        filesystem::remove(path);
+        wal = make_unique<BoundedAsyncWALLogger>(path, 1000, state.range(0));
+    }
+    for (auto _ : state) {
+        wal->log(record);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * record.size());
+    if (state.thread_index() == 0) {
+        wal.reset();
+        filesystem::remove(path);
+    }
+}
+BENCHMARK(BM_WalLog)
+    ->ArgNames({"batch", "bytes"})
+    ->ArgsProduct({{1, 10, 100, 1000}, {64, 1024}})
+    ->Threads(1)->Threads(4)
+    ->UseRealTime();
+
+static void BM_ShardHash(benchmark::State& state) {
+    string key(state.range(0), 'k');
+    hash<string> hasher;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hasher(key) % 16);
+    }
+    state.SetBytesProcessed(state.iterations() * key.size());
+}
+BENCHMARK(BM_ShardHash)->Arg(8)->Arg(32)->Arg(256);
+
+static void BM_Crc32(benchmark::State& state) {
+    string data(state.range(0), 'c');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(crc32(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc32)->Arg(64)->Arg(4096)->Arg(65536);
+
+static void BM_LatencyHistogramRecord(benchmark::State& state) {
+    static LatencyHistogram hist;
+    uint64_t ns = 1000 + state.thread_index();
+    for (auto _ : state) {
+        hist.record_ns(ns);
+        ns = ns * 1103515245 % 100000000;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LatencyHistogramRecord)->Threads(1)->Threads(4);
+
+// The transform as it used to run: 50,000 dependent updates of the first byte.
+static void legacy_transform(char* data, size_t len) {
+    volatile int result = 0;
+    for (int i = 0; i < 50000; i++) {
+        result += i;
+        if (len) data[0] = (data[0] + 1) % 128;
+    }
+}
+
+static void BM_ValueTransform(benchmark::State& state, transform_kernels::Kernel kernel, bool (*supported)()) {
+    if (supported && !supported()) {
+        state.SkipWithError("CPU lacks the required instruction set");
+        return;
+    }
+    string data(state.range(0), 'v');
+    for (auto _ : state) {
+        kernel(&data[0], data.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK_CAPTURE(BM_ValueTransform, legacy, legacy_transform, nullptr)->Arg(64)->Arg(4096)->Arg(65536);
+BENCHMARK_CAPTURE(BM_ValueTransform, scalar, transform_kernels::scalar, nullptr)->Arg(64)->Arg(4096)->Arg(65536);
+#ifdef KV_X86_KERNELS
+static bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+static bool has_avx512() { return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("bmi2"); }
+BENCHMARK_CAPTURE(BM_ValueTransform, avx2, transform_kernels::avx2, has_avx2)->Arg(64)->Arg(4096)->Arg(65536);
+BENCHMARK_CAPTURE(BM_ValueTransform, avx512, transform_kernels::avx512, has_avx512)->Arg(64)->Arg(4096)->Arg(65536);
+#endif
+
+BENCHMARK_MAIN();
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "kv_cache.h"
+
+// Per-thread L1 in front of ShardedKVCache for the handful of keys that take most reads.
+// Every worker thread keeps its own small map of key -> served value, tagged with the
+// owning shard's epoch as read before the value was fetched. A line is served only while
+// that epoch is unchanged, so any write or delete in the shard invalidates it. A hit costs one
+// thread-local lookup and one load of the epoch. It takes no lock and stores only to
+// memory this thread owns.
+//
+// Admission is decided by a sampling detector, also kept per thread. One miss in
+// sample_every is counted, and a key counted admit_after times gets a line if there is
+// room. Every decay_every samples the counts are halved and lines that served no hit since
+// the previous decay are dropped, so keys that cool down make room again. If admit is set,
+// for example to a process-wide hot-key detector, a key it accepts gets a line on its first
+// miss instead.
+//
+// Hits served here never reach the shared entry, whose hit count ranks keys for the hot-set
+// manifest (ShardedKVCache::hottest). Each line therefore credits its hits back in batches of
+// kCreditEvery, and the remainder when the line is dropped, at one shard lock per batch.
+class NearCache {
+public:
+    struct Options {
+        size_t capacity = 256;
+        uint32_t sample_every = 4;
+        uint32_t admit_after = 2;
+        uint32_t decay_every = 1024;
+        function<bool(const string&)> admit;
+    };
+
+    NearCache(shared_ptr<ShardedKVCache> cache, const Options& options)
+        : cache_(cache), options_(options), id_(next_id()) {}
+
+    // fetch() reads the shared cache and returns "" on a miss; its result is what gets
+    // stored, so the line holds whatever the caller serves.
+    template <typename Fetch>
+    string get(const string& key, Fetch&& fetch) {
+        Local& local = local_state();
+        size_t shard = cache_->shard_of(key);
+        uint64_t epoch = cache_->epoch(shard);
+        auto it = local.lines.find(key);
+        if (it != local.lines.end() && it->second.epoch == epoch) {
+            Line& line = it->second;
+            line.hits++;
+            if (++line.uncredited == kCreditEvery) credit(key, line);
+            hits_.inc();
+            return line.value;
+        }
+        misses_.inc();
+
+        string value = fetch();
+        if (it != local.lines.end()) {
+            if (value.empty()) {
+                credit(key, it->second);
+                local.lines.erase(it);
+            } else {
+                it->second.value = value;
+                it->second.epoch = epoch;
+            }
+        } else if (!value.empty() && local.lines.size() < options_.capacity &&
+                   ((options_.admit && options_.admit(key)) || sampled_hot(local, key))) {
+            local.lines.emplace(key, Line{value, epoch, 0, 0});
+            admitted_.inc();
+        }
+        return value;
+    }
+
+    void append_stats(ostream& out) {
+        out << "# TYPE kv_near_cache_hits_total counter\n"
+            << "kv_near_cache_hits_total " << hits_.value() << "\n"
+            << "# TYPE kv_near_cache_misses_total counter\n"
+            << "kv_near_cache_misses_total " << misses_.value() << "\n"
+            << "# TYPE kv_near_cache_admitted_total counter\n"
+            << "kv_near_cache_admitted_total " << admitted_.value() << "\n"
+            << "# TYPE kv_near_cache_evicted_total counter\n"
+            << "kv_near_cache_evicted_total " << evicted_.value() << "\n";
+    }
+
+private:
+    struct Line {
+        string value;
+        uint64_t epoch;
+        uint32_t hits;         // since the last decay
+        uint32_t uncredited;   // not yet added to the shared entry
+    };
+
+    static constexpr uint32_t kCreditEvery = 64;
+
+    void credit(const string& key, Line& line) {
+        if (line.uncredited == 0) return;
+        cache_->credit_hits(key, line.uncredited);
+        line.uncredited = 0;
+    }
+
+    struct Local {
+        uint64_t owner = 0;
+        unordered_map<string, Line> lines;
+        unordered_map<string, uint32_t> samples;
+        uint64_t misses = 0;
+        uint64_t sampled = 0;
+    };
+
+    static uint64_t next_id() {
+        static atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+    // One state per thread, reset if the thread last served a different NearCache.
+    Local& local_state() {
+        static thread_local Local local;
+        if (local.owner != id_) {
+            local = Local();
+            local.owner = id_;
+        }
+        return local;
+    }
+
+    bool sampled_hot(Local& local, const string& key) {
+        if (++local.misses % options_.sample_every != 0) return false;
+        uint32_t count = ++local.samples[key];
+        if (++local.sampled % options_.decay_every == 0) decay(local);
+        return count >= options_.admit_after;
+    }
+
+    void decay(Local& local) {
+        for (auto it = local.samples.begin(); it != local.samples.end();) {
+            if ((it->second /= 2) == 0) it = local.samples.erase(it);
+            else ++it;
+        }
+        for (auto it = local.lines.begin(); it != local.lines.end();) {
+            if (it->second.hits == 0) {
+                credit(it->first, it->second);
+                it = local.lines.erase(it);
+                evicted_.inc();
+            } else {
+                it->second.hits = 0;
+                ++it;
+            }
+        }
+    }
+
+    shared_ptr<ShardedKVCache> cache_;
+    Options options_;
+    uint64_t id_;
+    Counter hits_;
+    Counter misses_;
+    Counter admitted_;
+    Counter evicted_;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "metrics.h"
+
+struct LockStats {
+    string name;
+    Counter acquisitions;
+    Counter contended;
+    LatencyHistogram wait;
+    LatencyHistogram hold;
+};
+
+class LockRegistry {
+public:
+    // Never destroyed: metrics and locks in other statics release into it during exit.
+    static LockRegistry& instance() {
+        static LockRegistry* registry = new LockRegistry();
+        return *registry;
+    }
+
+    LockStats* add(const string& name) {
+        lock_guard<mutex> lock(mutex_);
+        locks_.push_back(make_unique<LockStats>());
+        locks_.back()->name = name;
+        return locks_.back().get();
+    }
+
+    // Drops a destroyed lock from the report and frees its metric slots.
+    void remove(LockStats* stats) {
+        lock_guard<mutex> lock(mutex_);
+        locks_.erase(remove_if(locks_.begin(), locks_.end(), [&](const unique_ptr<LockStats>& l) { return l.get() == stats; }),
+                     locks_.end());
+    }
+
+    void rename(LockStats* stats, const string& name) {
+        lock_guard<mutex> lock(mutex_);
+        stats->name = name;
+    }
+
+    // Hold times cost two clock reads per critical section, so they are only recorded
+    // while profiling is on; acquisition counts and contended waits are always recorded.
+    atomic<bool> profile_holds{false};
+
+    string to_json() {
+        lock_guard<mutex> lock(mutex_);
+        stringstream out;
+        out << "{\"profile_holds\":" << (profile_holds ? "true" : "false") << ",\"locks\":[";
+        for (size_t i = 0; i < locks_.size(); ++i) {
+            const auto& l = *locks_[i];
+            uint64_t acquisitions = l.acquisitions.value(), contended = l.contended.value();
+            auto wait = l.wait.snapshot();
+            auto hold = l.hold.snapshot();
+            out << (i ? ",\n" : "\n") << "{\"name\":\"" << json_escape(l.name) << "\",\"acquisitions\":" << acquisitions
+                << ",\"contended\":" << contended
+                << ",\"contention_ratio\":" << (acquisitions ? (double)contended / acquisitions : 0.0)
+                << ",\"wait_us\":{\"total\":" << wait.sum_ns / 1000.0 << ",\"p50\":" << wait.quantile_ns(0.5) / 1000.0
+                << ",\"p99\":" << wait.quantile_ns(0.99) / 1000.0 << ",\"max\":" << wait.quantile_ns(1.0) / 1000.0 << "}"
+                << ",\"hold_us\":{\"samples\":" << hold.count << ",\"p50\":" << hold.quantile_ns(0.5) / 1000.0
+                << ",\"p99\":" << hold.quantile_ns(0.99) / 1000.0 << ",\"max\":" << hold.quantile_ns(1.0) / 1000.0 << "}}";
+        }
+        out << "\n]}\n";
+        return out.str();
+    }
+
+private:
+    mutex mutex_;
+    vector<unique_ptr<LockStats>> locks_;
+};
+
+// Drop-in std::mutex replacement that counts acquisitions, detects contention with a
+// try_lock fast path and records how long contended callers waited (and, when profiling,
+// how long the lock was held). Pair it with condition_variable_any.
+class ProfiledMutex {
+public:
+    explicit ProfiledMutex(const string& name = "unnamed") : stats_(LockRegistry::instance().add(name)) {}
+
+    ~ProfiledMutex() {
+        LockRegistry::instance().remove(stats_);
+    }
+
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void set_name(const string& name) {
+        LockRegistry::instance().rename(stats_, name);
+    }
+
+    void lock() {
+        stats_->acquisitions.inc();
+        if (!mtx_.try_lock()) {
+            stats_->contended.inc();
+            auto start = chrono::steady_clock::now();
+            mtx_.lock();
+            stats_->wait.record(chrono::steady_clock::now() - start);
+        }
+        mark_acquired();
+    }
+
+    bool try_lock() {
+        if (!mtx_.try_lock()) return false;
+        stats_->acquisitions.inc();
+        mark_acquired();
+        return true;
+    }
+
+    void unlock() {
+        if (timing_hold_) {
+            timing_hold_ = false;
+            stats_->hold.record(chrono::steady_clock::now() - locked_at_);
+        }
+        mtx_.unlock();
+    }
+
+private:
+    void mark_acquired() {
+        if (LockRegistry::instance().profile_holds.load(memory_order_relaxed)) {
+            timing_hold_ = true;
+            locked_at_ = chrono::steady_clock::now();
+        }
+    }
+
+    mutex mtx_;
+    LockStats* stats_;
+    // Only touched by the current owner.
+    bool timing_hold_ = false;
+    chrono::steady_clock::time_point locked_at_;
+};
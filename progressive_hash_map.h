@@ -0,0 +1,204 @@
+#pragma once
+
+#include "kv_common.h"
+
+// String-keyed chained hash table for the cache shards that grows without a stop-the-world
+// rehash. Once it holds as many entries as buckets, a table twice the size is allocated and
+// the old buckets are moved over incrementally, as in Redis' dict: every find, insert and
+// erase first migrates one old bucket (skipping at most kMaxEmptyVisits empty ones), so no
+// single operation pays for more than one chain. While both tables are live, lookups check
+// both and inserts go to the new one. Nodes are relinked, never copied, so value pointers
+// stay valid across a resize.
+template <typename V>
+class ProgressiveHashMap {
+public:
+    ProgressiveHashMap() {
+        allocate(tables_[0], kInitialBuckets);
+    }
+
+    ~ProgressiveHashMap() {
+        for (auto& table : tables_) {
+            for (size_t i = 0; i < table.size; ++i) {
+                for (Node* node = table.buckets[i]; node;) {
+                    Node* next = node->next;
+                    delete node;
+                    node = next;
+                }
+            }
+            free(table.buckets);
+        }
+    }
+
+    ProgressiveHashMap(const ProgressiveHashMap&) = delete;
+    ProgressiveHashMap& operator=(const ProgressiveHashMap&) = delete;
+
+    V* find(const string& key) {
+        step();
+        Node* node = lookup(key, hasher_(key));
+        return node ? &node->value : nullptr;
+    }
+
+    // Returns the entry for key and whether it was inserted; V is only built from args if
+    // the key is absent.
+    template <typename... Args>
+    pair<V*, bool> try_emplace(const string& key, Args&&... args) {
+        step();
+        size_t hash = hasher_(key);
+        if (Node* node = lookup(key, hash)) return {&node->value, false};
+        maybe_grow();
+        Table& table = rehashing() ? tables_[1] : tables_[0];
+        Node*& head = table.buckets[table.index(hash)];
+        Node* node = new Node{key, V(forward<Args>(args)...), hash, head};
+        head = node;
+        table.used++;
+        return {&node->value, true};
+    }
+
+    size_t erase(const string& key) {
+        step();
+        size_t hash = hasher_(key);
+        for (int t = 0; t <= (rehashing() ? 1 : 0); ++t) {
+            Table& table = tables_[t];
+            for (Node** link = &table.buckets[table.index(hash)]; *link; link = &(*link)->next) {
+                Node* node = *link;
+                if (node->hash == hash && node->key == key) {
+                    *link = node->next;
+                    delete node;
+                    table.used--;
+                    return 1;
+                }
+            }
+        }
+        return 0;
+    }
+
+    size_t size() const {
+        return tables_[0].used + tables_[1].used;
+    }
+
+    bool rehashing() const {
+        return tables_[1].buckets != nullptr;
+    }
+
+    size_t resizes() const {
+        return resizes_;
+    }
+
+    // Cursor walk for callers that drop the lock between calls. A bucket holds one
+    // contiguous range of the mixed hash space, and growing splits each range in two, so the
+    // cursor is a position in that space: everything below it has been passed to fn. Each call
+    // visits whole ranges, in both tables while rehashing, until at least max_entries entries
+    // were seen, and returns the cursor to resume from, 0 once the walk is complete (start at
+    // 0 too). Resizes and migration carry on between calls; an entry present for the whole
+    // walk is visited exactly once, one inserted or erased meanwhile at most once.
+    template <typename Fn>
+    uint64_t scan(uint64_t cursor, size_t max_entries, Fn&& fn) {
+        size_t visited = 0;
+        do {
+            const Table& small = tables_[0];
+            size_t i = cursor >> small.shift;
+            uint64_t first = (uint64_t)i << small.shift;
+            uint64_t last = first | ((1ull << small.shift) - 1);
+            visited += visit_chain(small.buckets[i], fn);
+            if (rehashing()) {
+                const Table& large = tables_[1];
+                for (size_t j = first >> large.shift; j <= last >> large.shift; ++j) {
+                    visited += visit_chain(large.buckets[j], fn);
+                }
+            }
+            cursor = last + 1;
+        } while (cursor != 0 && visited < max_entries);
+        return cursor;
+    }
+
+private:
+    struct Node {
+        string key;
+        V value;
+        size_t hash;
+        Node* next;
+    };
+
+    // Buckets are indexed by the top bits of a Fibonacci-mixed hash: the shard was already
+    // picked from hash % shard_count, so the low bits are nearly the same within a shard.
+    struct Table {
+        Node** buckets = nullptr;
+        size_t size = 0;
+        size_t used = 0;
+        int shift = 64;
+
+        size_t index(size_t hash) const {
+            return (size_t)(((uint64_t)hash * 0x9E3779B97F4A7C15ull) >> shift);
+        }
+    };
+
+    static constexpr size_t kInitialBuckets = 16;
+    static constexpr size_t kMaxEmptyVisits = 10;
+
+    // calloc, so large bucket arrays come from fresh mmap'd pages that the kernel zeroes on
+    // first touch rather than being cleared up front while the shard lock is held.
+    static void allocate(Table& table, size_t size) {
+        table.buckets = (Node**)calloc(size, sizeof(Node*));
+        if (!table.buckets) throw bad_alloc();
+        table.size = size;
+        table.used = 0;
+        table.shift = 64 - __builtin_ctzll(size);
+    }
+
+    template <typename Fn>
+    static size_t visit_chain(Node* node, Fn& fn) {
+        size_t visited = 0;
+        for (; node; node = node->next, ++visited) fn(node->key, node->value);
+        return visited;
+    }
+
+    Node* lookup(const string& key, size_t hash) const {
+        for (int t = 0; t <= (rehashing() ? 1 : 0); ++t) {
+            const Table& table = tables_[t];
+            for (Node* node = table.buckets[table.index(hash)]; node; node = node->next) {
+                if (node->hash == hash && node->key == key) return node;
+            }
+        }
+        return nullptr;
+    }
+
+    void maybe_grow() {
+        if (rehashing() || tables_[0].used < tables_[0].size) return;
+        allocate(tables_[1], tables_[0].size * 2);
+        rehash_index_ = 0;
+        resizes_++;
+    }
+
+    void step() {
+        if (!rehashing()) return;
+        Table& from = tables_[0];
+        Table& to = tables_[1];
+        for (size_t empty = 0; !from.buckets[rehash_index_]; ) {
+            if (++rehash_index_ == from.size) return finish_rehash();
+            if (++empty == kMaxEmptyVisits) return;
+        }
+        for (Node* node = from.buckets[rehash_index_]; node;) {
+            Node* next = node->next;
+            Node*& head = to.buckets[to.index(node->hash)];
+            node->next = head;
+            head = node;
+            from.used--;
+            to.used++;
+            node = next;
+        }
+        from.buckets[rehash_index_] = nullptr;
+        if (++rehash_index_ == from.size) finish_rehash();
+    }
+
+    void finish_rehash() {
+        free(tables_[0].buckets);
+        tables_[0] = tables_[1];
+        tables_[1] = Table();
+        rehash_index_ = 0;
+    }
+
+    Table tables_[2];
+    size_t rehash_index_ = 0;
+    size_t resizes_ = 0;
+    hash<string> hasher_;
+};
@@ -3,5 +3,9 @@ CREATE DATABASE kv_store;
 USE kv_store;
 CREATE TABLE kv_pairs (
     id VARCHAR(255) PRIMARY KEY,
-    value TEXT
-);
\ No newline at end of file
+    value LONGBLOB
+);
+-- With --db-replica, the health check runs SHOW REPLICA STATUS on every replica, which
+-- needs REPLICATION CLIENT. Without it each replica is reported once and kept out of
+-- rotation. Run on the primary (it replicates), with the account and host the server uses:
+-- GRANT REPLICATION CLIENT ON *.* TO 'kv_server_user'@'%';
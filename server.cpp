@@ -1,264 +1,326 @@
 #include "httplib.h"
-#include <iostream>
-#include <string>
-#include <unordered_map>
-#include <mutex>
-#include <memory>
-#include <stdexcept>
-#include <fstream>
-#include <unistd.h> 
-#include <fcntl.h>
-#include <vector>
-#include <queue>
-#include <list>
-#include <condition_variable>
-#include <thread>
-#include <atomic>
-#include <functional>
-#include <sys/resource.h> 
-
-#include "cppconn/driver.h"
-#include "cppconn/exception.h"
-#include "cppconn/prepared_statement.h"
-#include "cppconn/resultset.h"
-#include "cppconn/statement.h"
-
-using namespace std;
-
-
-void perform_heavy_computation(string& data) {
-    volatile int result = 0;
-    for(int i = 0; i < 50000; i++) {
-        result += i;
-        if (!data.empty()) {
-            data[0] = (data[0] + 1) % 128;
-        }
+#include "kv_common.h"
+#include "metrics.h"
+#include "profiled_mutex.h"
+#include "wal.h"
+#include "kv_cache.h"
+#include "storage_backend.h"
+#include "db_manager.h"
+#include "log_store.h"
+#include "stub_backend.h"
+#include "cache_persistence.h"
+#include "value_transform.h"
+#include "compute_pool.h"
+#include "bulk_import.h"
+#include "near_cache.h"
+#include "hot_keys.h"
+
+// Captures the request stream (sampled or full) as JSONL for replay by load_generator.
+// Handlers only append a small record under a short lock; a background thread formats and
+// writes batches. When the writer falls behind, records are dropped rather than blocking.
+class RequestCapture {
+public:
+    static constexpr size_t kMaxPending = 65536;
+
+    struct Record {
+        int64_t ts_us;
+        const char* route;
+        string method;
+        string key;
+        size_t value_size;
+        int status;
+        int64_t latency_us;
+    };
+
+    static RequestCapture& instance() {
+        static RequestCapture capture;
+        return capture;
     }
-}
 
+    ~RequestCapture() {
+        stop();
+    }
 
-class BoundedAsyncWALLogger {
-public:
-    BoundedAsyncWALLogger() : stop_flag_(false), max_queue_size_(1000) {
-        logger_thread_ = thread(&BoundedAsyncWALLogger::process_logs, this);
+    // 1 in every sample_every requests is captured (1 captures everything).
+    bool start(const string& path, uint32_t sample_every) {
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd_ < 0) {
+            cerr << "[CAPTURE] Cannot open " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        sample_every_ = max<uint32_t>(1, sample_every);
+        enabled_ = true;
+        writer_ = thread(&RequestCapture::write_loop, this);
+        cout << "[CAPTURE] Writing 1 in " << sample_every_ << " requests to " << path << endl;
+        return true;
     }
 
-    ~BoundedAsyncWALLogger() {
+    void stop() {
+        if (!enabled_.exchange(false)) return;
         {
-            lock_guard<mutex> lock(queue_mutex_);
-            stop_flag_ = true;
-        }
-        cv_empty_.notify_one();
-        if (logger_thread_.joinable()) {
-            logger_thread_.join();
+            lock_guard<mutex> lock(mutex_);
+            stop_ = true;
         }
+        cv_.notify_one();
+        if (writer_.joinable()) writer_.join();
+        close(fd_);
     }
 
-    void log(const string& data) {
-        unique_lock<mutex> lock(queue_mutex_);
-        cv_full_.wait(lock, [this] { 
-            return log_queue_.size() < max_queue_size_; 
-        });
+    void record(const httplib::Request& req, const char* route, int status,
+                chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+        if (!enabled_.load(memory_order_relaxed)) return;
+        static thread_local uint32_t counter = 0;
+        if (++counter % sample_every_ != 0) return;
+
+        auto it = req.path_params.find("key");
+        Record r;
+        r.ts_us = chrono::duration_cast<chrono::microseconds>(
+            chrono::system_clock::now().time_since_epoch() - (end - start)).count();
+        r.route = route;
+        r.method = req.method;
+        r.key = it != req.path_params.end() ? it->second : req.get_param_value("key");
+        r.value_size = req.has_param("value") ? req.get_param_value("value").size()
+                       : req.body.empty() ? req.get_header_value_u64("Content-Length") : req.body.size();
+        r.status = status;
+        r.latency_us = chrono::duration_cast<chrono::microseconds>(end - start).count();
+
+        lock_guard<mutex> lock(mutex_);
+        if (pending_.size() >= kMaxPending) {
+            dropped_.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        pending_.push_back(move(r));
+    }
 
-        log_queue_.push(data);
-        cv_empty_.notify_one(); 
+    void append_stats(ostream& out) {
+        out << "# TYPE kv_capture_records_total counter\n"
+            << "kv_capture_records_total " << written_.load() << "\n"
+            << "# TYPE kv_capture_dropped_total counter\n"
+            << "kv_capture_dropped_total " << dropped_.load() << "\n";
     }
 
 private:
-    void process_logs() {
-        int fd = open("wal_simulation.log", O_WRONLY | O_CREAT | O_APPEND, 0644);
-        
-        
-        const size_t FIXED_BATCH_LIMIT = 100; 
+    RequestCapture() = default;
 
+    void write_loop() {
+        vector<Record> batch;
+        string buffer;
         while (true) {
-            unique_lock<mutex> lock(queue_mutex_);
-            
-            cv_empty_.wait(lock, [this] { return !log_queue_.empty() || stop_flag_; });
-
-            if (stop_flag_ && log_queue_.empty()) break;
-
-            
-            queue<string> local_batch;
-            size_t count = 0;
-            
-            while (!log_queue_.empty() && count < FIXED_BATCH_LIMIT) {
-                local_batch.push(log_queue_.front());
-                log_queue_.pop();
-                count++;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cv_.wait_for(lock, chrono::milliseconds(100), [this] { return stop_; });
+                batch.swap(pending_);
+                if (stop_ && batch.empty()) break;
             }
-            
-            cv_full_.notify_all(); 
-            lock.unlock(); 
-
-            string batch_data;
-            while (!local_batch.empty()) {
-                batch_data += local_batch.front() + "\n";
-                local_batch.pop();
+            if (batch.empty()) continue;
+
+            buffer.clear();
+            for (const auto& r : batch) {
+                buffer += "{\"ts_us\":" + to_string(r.ts_us) + ",\"method\":\"" + r.method +
+                          "\",\"route\":\"" + r.route + "\",\"key\":\"" + json_escape(r.key) +
+                          "\",\"value_size\":" + to_string(r.value_size) + ",\"status\":" + to_string(r.status) +
+                          ",\"latency_us\":" + to_string(r.latency_us) + "}\n";
             }
-
-            if (fd != -1 && !batch_data.empty()) {
-                write(fd, batch_data.c_str(), batch_data.size());
-                fdatasync(fd); 
+            size_t off = 0;
+            while (off < buffer.size()) {
+                ssize_t n = write(fd_, buffer.data() + off, buffer.size() - off);
+                if (n <= 0) break;
+                off += n;
             }
+            written_.fetch_add(batch.size(), memory_order_relaxed);
+            batch.clear();
         }
-        if (fd != -1) close(fd);
     }
 
-    queue<string> log_queue_;
-    mutex queue_mutex_;
-    condition_variable cv_empty_;
-    condition_variable cv_full_;
-    bool stop_flag_;
-    size_t max_queue_size_;
-    thread logger_thread_;
+    atomic<bool> enabled_{false};
+    uint32_t sample_every_ = 1;
+    int fd_ = -1;
+    mutex mutex_;
+    condition_variable cv_;
+    vector<Record> pending_;
+    bool stop_ = false;
+    thread writer_;
+    atomic<uint64_t> written_{0};
+    atomic<uint64_t> dropped_{0};
 };
 
-class ShardedKVCache {
-public:
-    ShardedKVCache() : shards_(16) {}
-
-    void create(const string& key, const string& value) {
-        size_t idx = get_shard_idx(key);
-        lock_guard<mutex> guard(shards_[idx].mtx);
-        shards_[idx].data[key] = value;
+// Runs one request under per-route request counting and latency recording, and traces
+// the sampled fraction of requests stage by stage.
+template <typename Call>
+void run_instrumented(RouteMetrics* metrics, const httplib::Request& req, httplib::Response& res, Call&& call) {
+    auto start = chrono::steady_clock::now();
+    RequestTrace trace;
+    bool sampled = TraceRegistry::instance().should_sample();
+    if (sampled) {
+        trace.start = start;
+        trace.wall_start = chrono::system_clock::now();
+        current_trace = &trace;
     }
 
-    string read(const string& key) {
-        size_t idx = get_shard_idx(key);
-        lock_guard<mutex> guard(shards_[idx].mtx);
-        auto it = shards_[idx].data.find(key);
-        if (it != shards_[idx].data.end()) {
-            return it->second;
-        }
-        return "";
+    int status;
+    try {
+        call();
+        status = res.status == -1 ? 200 : res.status;
+    } catch (...) {
+        current_trace = nullptr;
+        auto end = chrono::steady_clock::now();
+        metrics->record(500, end - start);
+        RequestCapture::instance().record(req, metrics->route.c_str(), 500, start, end);
+        throw;
     }
-
-    void del(const string& key) {
-        size_t idx = get_shard_idx(key);
-        lock_guard<mutex> guard(shards_[idx].mtx);
-        shards_[idx].data.erase(key);
+    auto end = chrono::steady_clock::now();
+    metrics->record(status, end - start);
+    RequestCapture::instance().record(req, metrics->route.c_str(), status, start, end);
+
+    if (sampled) {
+        current_trace = nullptr;
+        trace.route = metrics->route;
+        auto it = req.path_params.find("key");
+        trace.key = it != req.path_params.end() ? it->second : req.get_param_value("key");
+        trace.status = status;
+        trace.total_ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+        TraceRegistry::instance().publish(move(trace));
     }
+}
 
-private:
-    struct Shard {
-        mutex mtx;
-        unordered_map<string, string> data;
+httplib::Server::Handler instrument(const string& route, httplib::Server::Handler handler) {
+    RouteMetrics* metrics = &HttpMetrics::instance().route(route);
+    return [metrics, handler](const httplib::Request& req, httplib::Response& res) {
+        run_instrumented(metrics, req, res, [&] { handler(req, res); });
     };
+}
 
-    vector<Shard> shards_;
+// For handlers that read the request body themselves instead of having httplib buffer it.
+httplib::Server::HandlerWithContentReader instrument(const string& route,
+                                                     httplib::Server::HandlerWithContentReader handler) {
+    RouteMetrics* metrics = &HttpMetrics::instance().route(route);
+    return [metrics, handler](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+        run_instrumented(metrics, req, res, [&] { handler(req, res, reader); });
+    };
+}
 
-    size_t get_shard_idx(const string& key) {
-        hash<string> hasher;
-        return hasher(key) % shards_.size();
+// Reads an optional count from the query string, clamped to max. Anything but a plain
+// decimal number gets a 400 and false.
+bool count_param(const httplib::Request& req, httplib::Response& res, const string& name,
+                 size_t fallback, size_t max, size_t& out) {
+    if (!req.has_param(name)) {
+        out = fallback;
+        return true;
     }
-};
-
-class ConnectionPool {
-    string url_, user_, pass_, schema_;
-    int pool_size_;
-    list<shared_ptr<sql::Connection>> pool_;
-    mutex pool_mutex_;
-    condition_variable pool_cv_;
-
-public:
-    ConnectionPool(string url, string user, string pass, string schema, int size)
-        : url_(url), user_(user), pass_(pass), schema_(schema), pool_size_(size) {
-        
-        sql::Driver* driver = get_driver_instance();
-        for (int i = 0; i < pool_size_; ++i) {
-            try {
-                shared_ptr<sql::Connection> con(driver->connect(url_, user_, pass_));
-                con->setSchema(schema_);
-                pool_.push_back(con);
-            } catch (sql::SQLException &e) {
-                cerr << "Error creating connection pool: " << e.what() << endl;
-            }
-        }
-        cout << "[POOL] Initialized with " << pool_.size() << " connections." << endl;
-    }
-
-    shared_ptr<sql::Connection> getConnection() {
-        unique_lock<mutex> lock(pool_mutex_);
-        pool_cv_.wait(lock, [this] { return !pool_.empty(); });
-
-        auto con = pool_.front();
-        pool_.pop_front();
-        return con;
+    string value = req.get_param_value(name);
+    unsigned long long parsed;
+    auto [end, ec] = from_chars(value.data(), value.data() + value.size(), parsed);
+    if (value.empty() || ec == errc::invalid_argument || end != value.data() + value.size()) {
+        res.status = 400;
+        res.set_content("expected " + name + " to be a non-negative integer", "text/plain");
+        return false;
     }
+    out = ec == errc::result_out_of_range ? max : min<unsigned long long>(parsed, max);
+    return true;
+}
 
-    void releaseConnection(shared_ptr<sql::Connection> con) {
-        unique_lock<mutex> lock(pool_mutex_);
-        pool_.push_back(con);
-        lock.unlock();
-        pool_cv_.notify_one();
-    }
+struct ServerConfig {
+    int port = 8080;
+#ifdef KV_WITHOUT_MYSQL
+    string backend = "stub";
+#else
+    string backend = "mysql";
+#endif
+    DBConfig db;
+    LatencyModel stub_latency;
+    LogStoreConfig log_store;
+    string snapshot_path;
+    int snapshot_interval_s = 300;
+    string hotset_path;
+    size_t hotset_size = 10000;
+    int hotset_interval_s = 60;
+    string warmup_mode = "sync";
+    uint32_t trace_sample_every = 100;
+    bool lock_profiling = false;
+    size_t warmup_parallelism = 8;
+    string capture_path;
+    uint32_t capture_sample_every = 1;
+    size_t compute_threads = 0;
+    vector<int> compute_cores;
+    size_t compute_offload_bytes = 65536;
+    size_t import_workers = 4;
+    size_t max_body_bytes = 1ull << 30;
+    bool ordered_index = false;
+    bool near_cache = false;
+    size_t near_cache_lines = 256;
+    bool hotkeys = false;
+    uint32_t hotkeys_sample_every = 16;
 };
 
-class DBManager {
-public:
-    DBManager(shared_ptr<BoundedAsyncWALLogger> logger) : logger_(logger) {
-        pool_ = make_unique<ConnectionPool>(
-            "tcp://127.0.0.1:3306", "kv_server_user", "MyProjectPassword123!", "kv_store", 20
-        );
-    }
+vector<int> parse_core_list(const string& value) {
+    vector<int> cores;
+    stringstream ss(value);
+    for (string core; getline(ss, core, ',');) cores.push_back(stoi(core));
+    return cores;
+}
 
-    void create(const string& key, const string& value) {
-       
-        logger_->log(key + ":" + value);
-        auto con = pool_->getConnection();
-        try {
-            unique_ptr<sql::PreparedStatement> pstmt;
-            pstmt.reset(con->prepareStatement(
-                "INSERT INTO kv_pairs (id, value) VALUES (?, ?) ON DUPLICATE KEY UPDATE value = ?"
-            ));
-            pstmt->setString(1, key);
-            pstmt->setString(2, value);
-            pstmt->setString(3, value);
-            pstmt->execute();
-        } catch (sql::SQLException &e) {
-            cerr << "DB Error: " << e.what() << endl;
+// Flags take the form --name=value; --db-replica may be repeated.
+bool parse_args(int argc, char** argv, ServerConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == string::npos) {
+            cerr << "Unrecognized argument: " << arg << endl;
+            return false;
+        }
+        string name = arg.substr(2, eq - 2);
+        string value = arg.substr(eq + 1);
+
+        if (name == "port") config.port = stoi(value);
+        else if (name == "backend" && (value == "mysql" || value == "log" || value == "stub")) config.backend = value;
+        else if (name == "stub-latency" && config.stub_latency.parse(value)) {}
+        else if (name == "snapshot-path") config.snapshot_path = value;
+        else if (name == "snapshot-interval") config.snapshot_interval_s = stoi(value);
+        else if (name == "hotset-path") config.hotset_path = value;
+        else if (name == "hotset-size") config.hotset_size = stoul(value);
+        else if (name == "hotset-interval") config.hotset_interval_s = stoi(value);
+        else if (name == "warmup" && (value == "sync" || value == "async")) config.warmup_mode = value;
+        else if (name == "warmup-parallelism") config.warmup_parallelism = stoul(value);
+        else if (name == "trace-sample") config.trace_sample_every = stoul(value);
+        else if (name == "lock-profiling" && (value == "on" || value == "off")) config.lock_profiling = value == "on";
+        else if (name == "capture-path") config.capture_path = value;
+        else if (name == "capture-sample") config.capture_sample_every = stoul(value);
+        else if (name == "compute-threads") config.compute_threads = stoul(value);
+        else if (name == "compute-cores") config.compute_cores = parse_core_list(value);
+        else if (name == "compute-offload-bytes") config.compute_offload_bytes = stoul(value);
+        else if (name == "ordered-index" && (value == "on" || value == "off")) config.ordered_index = value == "on";
+        else if (name == "near-cache" && (value == "on" || value == "off")) config.near_cache = value == "on";
+        else if (name == "near-cache-lines") config.near_cache_lines = stoul(value);
+        else if (name == "hotkeys" && (value == "on" || value == "off")) config.hotkeys = value == "on";
+        else if (name == "hotkeys-sample") config.hotkeys_sample_every = max<uint32_t>(1, stoul(value));
+        else if (name == "import-workers") config.import_workers = max<size_t>(1, stoul(value));
+        else if (name == "max-body-bytes") config.max_body_bytes = stoull(value);
+        else if (name == "data-dir") config.log_store.data_dir = value;
+        else if (name == "log-sync" && (value == "always" || value == "none")) config.log_store.sync_writes = value == "always";
+        else if (name == "db-primary") config.db.primary_url = value;
+        else if (name == "db-replica") config.db.replica_urls.push_back(value);
+        else if (name == "db-user") config.db.user = value;
+        else if (name == "db-password") config.db.password = value;
+        else if (name == "db-schema") config.db.schema = value;
+        else if (name == "db-pool-min") config.db.pool_min = stoi(value);
+        else if (name == "db-pool-max") config.db.pool_max = stoi(value);
+        else if (name == "max-replica-lag") config.db.max_replica_lag_s = stoi(value);
+        else {
+            cerr << "Unknown flag or invalid value: " << arg << endl;
+            return false;
         }
-        pool_->releaseConnection(con);
-    }
-
-    string read(const string& key) {
-        auto con = pool_->getConnection();
-        string result = "";
-        try {
-            unique_ptr<sql::PreparedStatement> pstmt;
-            unique_ptr<sql::ResultSet> res;
-            pstmt.reset(con->prepareStatement("SELECT value FROM kv_pairs WHERE id = ?"));
-            pstmt->setString(1, key);
-            res.reset(pstmt->executeQuery());
-            
-            if (res->next()) {
-                result = res->getString("value");
-            }
-        } catch (sql::SQLException &e) {}
-        pool_->releaseConnection(con);
-        return result;
-    }
-
-    void del(const string& key) {
-        auto con = pool_->getConnection();
-        try {
-            unique_ptr<sql::PreparedStatement> pstmt;
-            pstmt.reset(con->prepareStatement("DELETE FROM kv_pairs WHERE id = ?"));
-            pstmt->setString(1, key);
-            pstmt->execute();
-        } catch (sql::SQLException &e) {}
-        pool_->releaseConnection(con);
     }
-
-private:
-    unique_ptr<ConnectionPool> pool_;
-    shared_ptr<BoundedAsyncWALLogger> logger_;
-};
+    return true;
+}
 
 
-int main() {
+int main(int argc, char** argv) {
+    ServerConfig config;
     try {
+        if (!parse_args(argc, argv, config)) {
+            return 1;
+        }
+
         struct rlimit limit;
         if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
             limit.rlim_cur = 65535;
@@ -267,14 +329,89 @@ int main() {
         }
 
         httplib::Server svr;
-        auto logger = make_shared<BoundedAsyncWALLogger>(); 
-        auto cache = make_shared<ShardedKVCache>();
-        auto db = make_shared<DBManager>(logger);
+        // httplib writes headers and body separately; without this, keep-alive clients
+        // stall ~40ms per response on Nagle vs. delayed ACK.
+        svr.set_tcp_nodelay(true);
+        // Bodies past this get a 413 before any handler runs; PUT and POST values are held
+        // to kMaxValueBytes on top, so this mainly bounds /admin/import requests.
+        svr.set_payload_max_length(config.max_body_bytes);
+        TraceRegistry::instance().set_sample_every(config.trace_sample_every);
+        LockRegistry::instance().profile_holds = config.lock_profiling;
+        if (!config.capture_path.empty() && !RequestCapture::instance().start(config.capture_path, config.capture_sample_every)) {
+            return 1;
+        }
+        auto cache = make_shared<ShardedKVCache>(16, config.ordered_index);
+        cout << "[COMPUTE] Transform kernel: " << transform_kernels::active().name << endl;
+        shared_ptr<ComputePool> compute;
+        if (config.compute_threads > 0) {
+            compute = make_shared<ComputePool>(config.compute_threads, config.compute_cores);
+        }
+        size_t offload_bytes = config.compute_offload_bytes;
+        shared_ptr<HotKeyTracker> hot;
+        if (config.hotkeys) {
+            HotKeyTracker::Options options;
+            options.sample_every = config.hotkeys_sample_every;
+            hot = make_shared<HotKeyTracker>(cache, options);
+            cout << "[HOTKEYS] Sampling 1 in " << options.sample_every << " accesses" << endl;
+        }
+        shared_ptr<NearCache> near;
+        if (config.near_cache) {
+            NearCache::Options options;
+            options.capacity = config.near_cache_lines;
+            if (hot) options.admit = [hot](const string& key) { return hot->is_hot(key); };
+            near = make_shared<NearCache>(cache, options);
+            cout << "[NEAR] Per-thread near-cache, " << options.capacity << " lines per thread" << endl;
+        }
+        shared_ptr<StorageBackend> db;
+        if (config.backend == "mysql") {
+#ifdef KV_WITHOUT_MYSQL
+            cerr << "Built with KV_WITHOUT_MYSQL; use --backend=stub or --backend=log" << endl;
+            return 1;
+#else
+            auto logger = make_shared<BoundedAsyncWALLogger>(); 
+            db = make_shared<DBManager>(logger, config.db);
+#endif
+        } else if (config.backend == "stub") {
+            cout << "[STUB] In-memory backend, injected latency: " << config.stub_latency.spec() << endl;
+            db = make_shared<StubBackend>(make_shared<BoundedAsyncWALLogger>(), config.stub_latency);
+        } else {
+            db = make_shared<LogStructuredStore>(config.log_store);
+        }
+
+        shared_ptr<CacheSnapshotter> snapshotter;
+        if (!config.snapshot_path.empty()) {
+            snapshotter = make_shared<CacheSnapshotter>(cache, db, config.snapshot_path,
+                                                        chrono::seconds(config.snapshot_interval_s));
+            if (snapshotter->load() > 0) {
+                if (config.warmup_mode == "sync") {
+                    snapshotter->verify(config.warmup_parallelism);
+                } else {
+                    snapshotter->verify_async(config.warmup_parallelism);
+                }
+            }
+        }
 
-        svr.Post("/kv", [cache, db](const httplib::Request& req, httplib::Response& res) {
+        shared_ptr<HotSetManager> hotset;
+        if (!config.hotset_path.empty()) {
+            hotset = make_shared<HotSetManager>(cache, db, config.hotset_path, config.hotset_size,
+                                                chrono::seconds(config.hotset_interval_s));
+            if (config.warmup_mode == "sync") {
+                hotset->prefetch(config.warmup_parallelism);
+            } else {
+                hotset->prefetch_async(config.warmup_parallelism);
+            }
+        }
+
+        svr.Post("/kv", instrument("POST /kv", [cache, db, hot](const httplib::Request& req, httplib::Response& res) {
             if (req.has_param("key") && req.has_param("value")) {
                 string key = req.get_param_value("key");
                 string value = req.get_param_value("value");
+                if (hot) hot->record(key, true);
+                if (value.size() > kMaxValueBytes) {
+                    res.status = 413;
+                    res.set_content("Value too large", "text/plain");
+                    return;
+                }
 
                 db->create(key, value);
                 cache->create(key, value);
@@ -283,35 +420,305 @@ int main() {
             } else {
                 res.status = 400;
             }
-        });
+        }));
+
+        // The transform only changes when a key is rewritten, so the cache keeps the transformed
+        // value per entry version and reruns this on the first read after a write.
+        auto transform = [compute, offload_bytes](string& value) {
+            ScopedTimer timer(stage_metrics().transform);
+            if (compute && value.size() >= offload_bytes) {
+                compute->run([&value] { perform_heavy_computation(value); });
+            } else {
+                perform_heavy_computation(value);
+            }
+        };
 
-        svr.Get("/kv/:key", [cache, db](const httplib::Request& req, httplib::Response& res) {
+        // The value is the raw request body, stored byte for byte: no form decoding, and the
+        // buffer is sized from Content-Length (at most kMaxValueBytes) and then moved into the
+        // cache. A longer body is read to the end and dropped so the connection stays usable.
+        svr.Put("/kv/:key", instrument("PUT /kv/:key", [cache, db, hot](const httplib::Request& req, httplib::Response& res,
+                                                                         const httplib::ContentReader& reader) {
             string key = req.path_params.at("key");
+            if (hot) hot->record(key, true);
+            string value;
+            value.reserve(min<uint64_t>(req.get_header_value_u64("Content-Length"), kMaxValueBytes));
+            bool too_large = false;
+            bool complete = reader([&](const char* data, size_t len) {
+                if (!too_large && value.size() + len > kMaxValueBytes) {
+                    too_large = true;
+                    string().swap(value);
+                }
+                if (!too_large) value.append(data, len);
+                return true;
+            });
+            // httplib has set the status already, 413 past --max-body-bytes.
+            if (!complete) return;
+            if (too_large) {
+                res.status = 413;
+                res.set_content("Value too large", "text/plain");
+                return;
+            }
+            if (value.empty()) {
+                res.status = 400;
+                res.set_content("Empty value", "text/plain");
+                return;
+            }
 
-            string value = cache->read(key);
+            db->create(key, value);
+            cache->create(key, move(value));
+            res.set_content("Created", "text/plain");
+        }));
+
+        svr.Get("/kv/:key", instrument("GET /kv/:key", [cache, db, transform, near, hot](const httplib::Request& req, httplib::Response& res) {
+            string key = req.path_params.at("key");
+            if (hot) hot->record(key, false);
+
+            string value;
+            // Taken before the backend read: a miss is only cached if no write or delete
+            // reached the shard while the backend was being read.
+            uint64_t epoch = cache->epoch(cache->shard_of(key));
+            {
+                ScopedTimer timer(stage_metrics().cache_lookup);
+                if (near) {
+                    value = near->get(key, [&] { return cache->read_derived(key, transform); });
+                } else {
+                    value = cache->read_derived(key, transform);
+                }
+            }
             if (!value.empty()) {
-                perform_heavy_computation(value);
                 res.set_content(value, "text/plain");
             } else {
                 value = db->read(key);
                 if (!value.empty()) {
-                    cache->create(key, value);
+                    cache->fill(key, value, epoch);
                     res.set_content(value, "text/plain");
                 } else {
                     res.status = 404;
                     res.set_content("Key not found", "text/plain");
                 }
             }
-        });
+        }));
+
+        // Ordered scan over cached keys: ?prefix= filters, ?limit= caps the page (default 100),
+        // ?start= is an inclusive lower bound and ?cursor= (next_cursor of the previous page)
+        // an exclusive one. Values are returned as stored.
+        svr.Get("/kv", instrument("GET /kv", [cache](const httplib::Request& req, httplib::Response& res) {
+            if (!cache->has_ordered_index()) {
+                res.status = 501;
+                res.set_content("Scans need the ordered index (start with --ordered-index=on)", "text/plain");
+                return;
+            }
+            size_t limit;
+            if (!count_param(req, res, "limit", 100, 10000, limit)) return;
+            bool inclusive = !req.has_param("cursor");
+            string bound = req.get_param_value(inclusive ? "start" : "cursor");
+            auto page = cache->scan_prefix(req.get_param_value("prefix"), bound, inclusive, limit);
+            const auto& items = page.items;
+
+            string out = "{\"items\":[";
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (i) out += ',';
+                out += "{\"key\":\"" + json_escape(items[i].first) + "\",\"value\":\"" + json_escape(items[i].second) + "\"}";
+            }
+            out += "]";
+            if (page.more) out += ",\"next_cursor\":\"" + json_escape(page.next_cursor) + "\"";
+            out += "}";
+            res.set_content(out, "application/json");
+        }));
 
-        svr.Delete("/kv/:key", [cache, db](const httplib::Request& req, httplib::Response& res) {
+        svr.Delete("/kv/:key", instrument("DELETE /kv/:key", [cache, db, hot](const httplib::Request& req, httplib::Response& res) {
             string key = req.path_params.at("key");
+            if (hot) hot->record(key, true);
             db->del(key);
             cache->del(key);
             res.set_content("Deleted " + key, "text/plain");
+        }));
+
+        // ?format=ndjson|binary, ?cache=off to load only the backend. Records parsed before a
+        // malformed one are still applied; the response says how far the import got.
+        size_t import_workers = config.import_workers;
+        svr.Post("/admin/import", instrument("POST /admin/import", [cache, db, import_workers](
+                const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+            BulkImport::Options options;
+            string format = req.has_param("format") ? req.get_param_value("format") : "ndjson";
+            if (format != "ndjson" && format != "binary") {
+                res.status = 400;
+                res.set_content("expected format=ndjson|binary", "text/plain");
+                return;
+            }
+            options.format = format == "binary" ? BulkImport::Binary : BulkImport::Ndjson;
+            options.fill_cache = req.get_param_value("cache") != "off";
+            options.workers = import_workers;
+
+            auto start = chrono::steady_clock::now();
+            BulkImport import(cache, db, options);
+            reader([&](const char* data, size_t len) { return import.feed(data, len); });
+            bool ok, backend_failed = false;
+            string error;
+            try {
+                ok = import.finish();
+                if (!ok) error = import.error();
+            } catch (const exception& e) {
+                // Chunks the backend rejected were neither counted nor cached.
+                ok = false;
+                backend_failed = true;
+                error = string("backend: ") + e.what();
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            stringstream out;
+            out << "{\"records\":" << import.records() << ",\"skipped\":" << import.skipped()
+                << ",\"chunks\":" << import.chunks() << ",\"bytes\":" << import.bytes()
+                << ",\"seconds\":" << seconds;
+            if (!ok) out << ",\"error\":\"" << json_escape(error) << "\"";
+            out << "}";
+            if (!ok) res.status = backend_failed ? 500 : 400;
+            res.set_content(out.str(), "application/json");
+            cout << "[IMPORT] " << import.records() << " records, " << import.bytes() << " bytes in " << seconds << "s"
+                 << (ok ? "" : " (stopped: " + error + ")") << endl;
+        }));
+
+        // Streams every entry (optionally ?prefix=...) as chunked output in the import formats.
+        // ?source=cache copies one page of a shard at a time and writes it with nothing held
+        // but the shard's scan cursor; ?source=store pages through the backend.
+        svr.Get("/admin/export", [cache, db](const httplib::Request& req, httplib::Response& res) {
+            string format = req.has_param("format") ? req.get_param_value("format") : "ndjson";
+            string source = req.has_param("source") ? req.get_param_value("source") : "cache";
+            if ((format != "ndjson" && format != "binary") || (source != "cache" && source != "store")) {
+                res.status = 400;
+                res.set_content("expected format=ndjson|binary and source=cache|store", "text/plain");
+                return;
+            }
+            auto fmt = format == "binary" ? BulkImport::Binary : BulkImport::Ndjson;
+            string prefix = req.get_param_value("prefix");
+            res.set_chunked_content_provider(
+                fmt == BulkImport::Binary ? "application/octet-stream" : "application/x-ndjson",
+                [cache, db, fmt, prefix, source](size_t, httplib::DataSink& sink) {
+                    auto start = chrono::steady_clock::now();
+                    size_t records = 0, bytes = 0;
+                    bool open = true;
+                    string buf;
+                    auto emit = [&](vector<pair<string, string>>& batch) {
+                        buf.clear();
+                        for (const auto& [key, value] : batch) {
+                            if (key.compare(0, prefix.size(), prefix) != 0) continue;
+                            BulkImport::encode(fmt, key, value, buf);
+                            records++;
+                        }
+                        if (!buf.empty()) open = sink.write(buf.data(), buf.size());
+                        bytes += buf.size();
+                        return open;
+                    };
+                    if (source == "store") {
+                        if (!db->scan(prefix, 1000, emit)) {
+                            cerr << "[EXPORT] Backend does not support scans" << endl;
+                            return false;
+                        }
+                    } else {
+                        vector<pair<string, string>> batch;
+                        for (size_t shard = 0; shard < cache->shard_count() && open; ++shard) {
+                            uint64_t cursor = 0;
+                            do {
+                                batch.clear();
+                                cursor = cache->scan_shard_page(shard, cursor, 1024, batch);
+                                emit(batch);
+                            } while (cursor != 0 && open);
+                        }
+                    }
+                    if (!open) return false;
+                    sink.done();
+                    cout << "[EXPORT] " << records << " records, " << bytes << " bytes from " << source << " in "
+                         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << "s" << endl;
+                    return true;
+                });
+        });
+
+        svr.Post("/admin/snapshot", instrument("POST /admin/snapshot", [snapshotter](const httplib::Request&, httplib::Response& res) {
+            if (!snapshotter) {
+                res.status = 404;
+                res.set_content("Snapshots disabled (start with --snapshot-path)", "text/plain");
+            } else if (snapshotter->request()) {
+                res.status = 202;
+                res.set_content("Snapshot started", "text/plain");
+            } else {
+                res.status = 409;
+                res.set_content("Snapshot already pending", "text/plain");
+            }
+        }));
+
+        svr.Get("/stats", instrument("GET /stats", [db, snapshotter](const httplib::Request&, httplib::Response& res) {
+            stringstream out;
+            db->append_stats(out);
+            if (snapshotter) {
+                out << "cache_snapshots_written_total " << snapshotter->snapshots_written() << "\n";
+            }
+            res.set_content(out.str(), "text/plain");
+        }));
+
+        svr.Get("/debug/traces", [](const httplib::Request& req, httplib::Response& res) {
+            size_t limit;
+            if (!count_param(req, res, "limit", 20, 10000, limit)) return;
+            auto traces = TraceRegistry::instance().slowest(limit);
+            if (req.get_param_value("format") == "chrome") {
+                res.set_content(traces_to_chrome(traces), "application/json");
+            } else {
+                res.set_content(traces_to_json(traces), "application/json");
+            }
+        });
+
+        // Sampled top keys by estimated rate (?n=, default 20) and the load on each cache shard.
+        svr.Get("/admin/hotkeys", [hot](const httplib::Request& req, httplib::Response& res) {
+            if (!hot) {
+                res.status = 501;
+                res.set_content("Hot-key tracking is off (start with --hotkeys=on)", "text/plain");
+                return;
+            }
+            size_t n;
+            if (!count_param(req, res, "n", 20, 10000, n)) return;
+            res.set_content(hot->to_json(n), "application/json");
+        });
+
+        svr.Get("/debug/locks", [](const httplib::Request&, httplib::Response& res) {
+            res.set_content(LockRegistry::instance().to_json(), "application/json");
+        });
+
+        // ?holds=on|off toggles hold-time profiling without a restart.
+        svr.Post("/debug/locks", [](const httplib::Request& req, httplib::Response& res) {
+            string holds = req.get_param_value("holds");
+            if (holds != "on" && holds != "off") {
+                res.status = 400;
+                res.set_content("expected holds=on|off", "text/plain");
+                return;
+            }
+            LockRegistry::instance().profile_holds = holds == "on";
+            res.set_content(LockRegistry::instance().to_json(), "application/json");
+        });
+
+        svr.Get("/metrics", [cache, db, compute, near, hot](const httplib::Request&, httplib::Response& res) {
+            stringstream out;
+            HttpMetrics::instance().render(out);
+            cache->append_stats(out);
+            db->append_stats(out);
+            RequestCapture::instance().append_stats(out);
+            if (compute) compute->append_stats(out);
+            if (near) near->append_stats(out);
+            if (hot) hot->append_stats(out);
+            res.set_content(out.str(), "text/plain; version=0.0.4");
+        });
+
+        svr.set_exception_handler([](const httplib::Request&, httplib::Response& res, exception_ptr ep) {
+            try {
+                rethrow_exception(ep);
+            } catch (const PoolTimeoutError& e) {
+                res.status = 503;
+                res.set_content(string("Database unavailable: ") + e.what(), "text/plain");
+            } catch (const exception& e) {
+                res.status = 500;
+                res.set_content(e.what(), "text/plain");
+            }
         });
 
-        int port = 8080;
+        int port = config.port;
         cout << "Starting server (Fixed Batch Cap 100) on port " << port << "..." << endl;
         if (!svr.listen("0.0.0.0", port)) {
             return 1;
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "kv_common.h"
+
+// Largest value the server accepts. MySQL's default max_allowed_packet is 64 MiB, and the
+// log store and WAL frame value lengths as 32 bits.
+constexpr uint64_t kMaxValueBytes = 64ull << 20;
+
+struct WriteOp {
+    enum Type { Put, Delete };
+    Type type;
+    string key;
+    string value;
+};
+
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    virtual void create(const string& key, const string& value) = 0;
+    virtual string read(const string& key) = 0;
+    virtual void del(const string& key) = 0;
+    // Applies all ops in order; backends make the batch atomic where they can. Throws if
+    // the batch was not applied.
+    virtual void batch(const vector<WriteOp>& ops) = 0;
+
+    // Returns the (key, value) pairs that exist among keys, in no particular order.
+    virtual vector<pair<string, string>> read_batch(const vector<string>& keys) {
+        vector<pair<string, string>> found;
+        for (const auto& key : keys) {
+            string value = read(key);
+            if (!value.empty()) found.emplace_back(key, move(value));
+        }
+        return found;
+    }
+
+    // Hands fn batches of up to batch_size (key, value) pairs whose key starts with prefix;
+    // fn returns false to stop early. Returns false if the backend cannot scan.
+    virtual bool scan(const string& /*prefix*/, size_t /*batch_size*/,
+                      const function<bool(vector<pair<string, string>>&)>& /*fn*/) {
+        return false;
+    }
+
+    virtual void append_stats(ostream& /*out*/) {}
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "storage_backend.h"
+#include "metrics.h"
+#include "wal.h"
+#include <random>
+
+// Injected per-query latency for StubBackend. Specs:
+//   none                         no delay
+//   fixed:US[:JITTER_US]         US plus uniform jitter in [0, JITTER_US)
+//   lognormal:MEDIAN_US:SIGMA    lognormal with the given median and shape
+//   replay:PATH                  samples drawn from recorded latencies, one per line in
+//                                microseconds, or the latency_us field of a capture JSONL
+class LatencyModel {
+public:
+    enum Kind { None, Fixed, LogNormal, Replay };
+
+    // Returns false (and leaves the model untouched) if spec is malformed. Everything is
+    // parsed into locals first and only assigned once the whole spec has been accepted.
+    bool parse(const string& spec) {
+        vector<string> parts;
+        stringstream ss(spec);
+        for (string part; getline(ss, part, ':');) parts.push_back(part);
+        if (parts.empty()) return false;
+        Kind kind;
+        double a = 0, b = 0;
+        vector<double> samples;
+        try {
+            if (parts[0] == "none" && parts.size() == 1) {
+                kind = None;
+            } else if (parts[0] == "fixed" && (parts.size() == 2 || parts.size() == 3)) {
+                kind = Fixed;
+                a = stod(parts[1]);
+                b = parts.size() == 3 ? stod(parts[2]) : 0;
+            } else if (parts[0] == "lognormal" && parts.size() == 3) {
+                kind = LogNormal;
+                a = log(stod(parts[1]));
+                b = stod(parts[2]);
+            } else if (parts[0] == "replay" && parts.size() >= 2) {
+                // The path may itself contain ':'.
+                if (!load_samples(spec.substr(spec.find(':') + 1), samples)) return false;
+                kind = Replay;
+            } else {
+                return false;
+            }
+        } catch (const exception&) {
+            return false;
+        }
+        kind_ = kind;
+        a_ = a;
+        b_ = b;
+        samples_ = move(samples);
+        spec_ = spec;
+        return true;
+    }
+
+    const string& spec() const { return spec_; }
+
+    chrono::nanoseconds sample() const {
+        static thread_local mt19937_64 gen(hash<thread::id>{}(this_thread::get_id()));
+        double us = 0;
+        switch (kind_) {
+            case None: break;
+            case Fixed: us = a_ + (b_ > 0 ? uniform_real_distribution<double>(0, b_)(gen) : 0); break;
+            case LogNormal: us = lognormal_distribution<double>(a_, b_)(gen); break;
+            case Replay: us = samples_[uniform_int_distribution<size_t>(0, samples_.size() - 1)(gen)]; break;
+        }
+        return chrono::nanoseconds((int64_t)(us * 1000));
+    }
+
+    // Blocks the calling thread for one sampled latency, like a synchronous DB round trip.
+    // Sleeps for the bulk and spins the last stretch, since sleep_for alone overshoots short
+    // delays by tens of microseconds.
+    void inject() const {
+        if (kind_ == None) return;
+        auto deadline = chrono::steady_clock::now() + sample();
+        auto spin_from = deadline - chrono::microseconds(60);
+        if (chrono::steady_clock::now() < spin_from) this_thread::sleep_until(spin_from);
+        while (chrono::steady_clock::now() < deadline) {}
+    }
+
+private:
+    static bool load_samples(const string& path, vector<double>& samples) {
+        ifstream in(path);
+        if (!in) return false;
+        for (string line; getline(in, line);) {
+            size_t pos = line.find("\"latency_us\":");
+            const char* start = pos == string::npos ? line.c_str() : line.c_str() + pos + 13;
+            char* end;
+            double us = strtod(start, &end);
+            if (end != start && us >= 0) samples.push_back(us);
+        }
+        return !samples.empty();
+    }
+
+    Kind kind_ = None;
+    double a_ = 0, b_ = 0;
+    vector<double> samples_;
+    string spec_ = "none";
+};
+
+// In-process stand-in for DBManager: same WAL traffic on writes, an in-memory table for
+// storage, and an injected delay per query instead of a MySQL round trip. Lets cache, WAL
+// and networking changes be measured on one box, and DB latency be varied on purpose.
+class StubBackend : public StorageBackend {
+public:
+    StubBackend(shared_ptr<BoundedAsyncWALLogger> logger, const LatencyModel& latency)
+        : logger_(logger), latency_(latency) {}
+
+    void create(const string& key, const string& value) override {
+        string wal_record;
+        BoundedAsyncWALLogger::append_record(wal_record, key, value);
+        logger_->log(move(wal_record));
+        query();
+        lock_guard<shared_mutex> lock(mutex_);
+        data_[key] = value;
+    }
+
+    string read(const string& key) override {
+        query();
+        shared_lock<shared_mutex> lock(mutex_);
+        auto it = data_.find(key);
+        return it == data_.end() ? "" : it->second;
+    }
+
+    void del(const string& key) override {
+        query();
+        lock_guard<shared_mutex> lock(mutex_);
+        data_.erase(key);
+    }
+
+    void batch(const vector<WriteOp>& ops) override {
+        string wal_record;
+        for (const auto& op : ops) {
+            if (op.type == WriteOp::Put) BoundedAsyncWALLogger::append_record(wal_record, op.key, op.value);
+        }
+        if (!wal_record.empty()) logger_->log(move(wal_record));
+        query();
+        lock_guard<shared_mutex> lock(mutex_);
+        for (const auto& op : ops) {
+            if (op.type == WriteOp::Put) data_[op.key] = op.value;
+            else data_.erase(op.key);
+        }
+    }
+
+    vector<pair<string, string>> read_batch(const vector<string>& keys) override {
+        query();
+        vector<pair<string, string>> found;
+        shared_lock<shared_mutex> lock(mutex_);
+        for (const auto& key : keys) {
+            auto it = data_.find(key);
+            if (it != data_.end()) found.emplace_back(key, it->second);
+        }
+        return found;
+    }
+
+    bool scan(const string& prefix, size_t batch_size,
+              const function<bool(vector<pair<string, string>>&)>& fn) override {
+        vector<string> keys;
+        {
+            shared_lock<shared_mutex> lock(mutex_);
+            for (const auto& [key, value] : data_) {
+                if (key.compare(0, prefix.size(), prefix) == 0) keys.push_back(key);
+            }
+        }
+        for (size_t i = 0; i < keys.size(); i += batch_size) {
+            vector<string> slice(keys.begin() + i, keys.begin() + min(i + batch_size, keys.size()));
+            auto batch = read_batch(slice);
+            if (!batch.empty() && !fn(batch)) break;
+        }
+        return true;
+    }
+
+    void append_stats(ostream& out) override {
+        out << "stub_queries_total " << queries_.load() << "\n"
+            << "stub_injected_seconds_total " << injected_ns_.load() / 1e9 << "\n";
+        shared_lock<shared_mutex> lock(mutex_);
+        out << "stub_keys " << data_.size() << "\n";
+    }
+
+private:
+    void query() {
+        auto start = chrono::steady_clock::now();
+        {
+            ScopedTimer timer(stage_metrics().db_execute);
+            latency_.inject();
+        }
+        queries_.fetch_add(1, memory_order_relaxed);
+        injected_ns_.fetch_add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(),
+                               memory_order_relaxed);
+    }
+
+    shared_ptr<BoundedAsyncWALLogger> logger_;
+    LatencyModel latency_;
+    shared_mutex mutex_;
+    unordered_map<string, string> data_;
+    atomic<long long> queries_{0};
+    atomic<long long> injected_ns_{0};
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "kv_common.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KV_X86_KERNELS 1
+#endif
+
+// The per-value transform on the GET hit path. The original stage ran a 50,000-iteration
+// loop of data[0] = (data[0] + 1) % 128, which for any starting byte lands on
+// (b + 50000) mod 128 == (b + 80) & 0x7F. The kernels apply that closed form to every
+// byte of the value, vectorized where the CPU allows; the variant is picked once at startup.
+namespace transform_kernels {
+
+constexpr uint8_t kShift = 50000 % 128;
+
+inline void scalar(char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) data[i] = (char)(((uint8_t)data[i] + kShift) & 0x7F);
+}
+
+#ifdef KV_X86_KERNELS
+__attribute__((target("avx2"))) inline void avx2(char* data, size_t len) {
+    const __m256i shift = _mm256_set1_epi8((char)kShift);
+    const __m256i mask = _mm256_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        v = _mm256_and_si256(_mm256_add_epi8(v, shift), mask);
+        _mm256_storeu_si256((__m256i*)(data + i), v);
+    }
+    scalar(data + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw,bmi2"))) inline void avx512(char* data, size_t len) {
+    const __m512i shift = _mm512_set1_epi8((char)kShift);
+    const __m512i mask = _mm512_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void*)(data + i));
+        v = _mm512_and_si512(_mm512_add_epi8(v, shift), mask);
+        _mm512_storeu_si512((void*)(data + i), v);
+    }
+    if (i < len) {
+        __mmask64 tail = _bzhi_u64(~0ull, len - i);
+        __m512i v = _mm512_maskz_loadu_epi8(tail, data + i);
+        v = _mm512_and_si512(_mm512_add_epi8(v, shift), mask);
+        _mm512_mask_storeu_epi8(data + i, tail, v);
+    }
+}
+#endif
+
+using Kernel = void (*)(char*, size_t);
+
+struct Selected {
+    Kernel fn;
+    const char* name;
+};
+
+inline Selected select() {
+#ifdef KV_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("bmi2")) return {avx512, "avx512"};
+    if (__builtin_cpu_supports("avx2")) return {avx2, "avx2"};
+#endif
+    return {scalar, "scalar"};
+}
+
+inline const Selected& active() {
+    static const Selected selected = select();
+    return selected;
+}
+
+}  // namespace transform_kernels
+
+inline void perform_heavy_computation(string& data) {
+    transform_kernels::active().fn(&data[0], data.size());
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "profiled_mutex.h"
+
+// Writes WAL entries from a bounded queue on a background thread, a batch per write and
+// fdatasync. Entries are concatenated as given, so callers frame them with append_record:
+//   crc32 | key_len | value_len | key | value   (crc covers the rest, lengths little-endian)
+// Keys and values may hold any bytes; replay() stops at the first truncated or corrupt record.
+class BoundedAsyncWALLogger {
+public:
+    explicit BoundedAsyncWALLogger(const string& path = "wal_simulation.log", size_t max_queue_size = 1000,
+                                   size_t batch_limit = 100)
+        : path_(path), stop_flag_(false), max_queue_size_(max_queue_size), batch_limit_(batch_limit) {
+        logger_thread_ = thread(&BoundedAsyncWALLogger::process_logs, this);
+    }
+
+    ~BoundedAsyncWALLogger() {
+        {
+            lock_guard<ProfiledMutex> lock(queue_mutex_);
+            stop_flag_ = true;
+        }
+        cv_empty_.notify_one();
+        if (logger_thread_.joinable()) {
+            logger_thread_.join();
+        }
+    }
+
+    // By value: callers passing a temporary record have it moved into the queue.
+    void log(string data) {
+        ScopedTimer timer(stage_metrics().wal_enqueue);
+        unique_lock<ProfiledMutex> lock(queue_mutex_);
+        cv_full_.wait(lock, [this] { 
+            return log_queue_.size() < max_queue_size_; 
+        });
+
+        size_t size = data.size();
+        log_queue_.push(move(data));
+        KV_PROBE2(wal__enqueue, log_queue_.size(), size);
+        cv_empty_.notify_one(); 
+    }
+
+    static void append_record(string& buf, const string& key, const string& value) {
+        size_t start = buf.size();
+        uint32_t key_len = key.size(), value_len = value.size();
+        buf.resize(start + kHeaderSize);
+        memcpy(&buf[start + 4], &key_len, 4);
+        memcpy(&buf[start + 8], &value_len, 4);
+        buf += key;
+        buf += value;
+        uint32_t crc = crc32(buf.data() + start + 4, buf.size() - start - 4);
+        memcpy(&buf[start], &crc, 4);
+    }
+
+    // Calls fn(key, value) for each intact record in the file, in write order, and returns
+    // how many there were. A torn write at the tail ends the replay.
+    static size_t replay(const string& path, const function<void(const string&, const string&)>& fn) {
+        ifstream in(path, ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        size_t offset = 0, records = 0;
+        while (data.size() - offset >= kHeaderSize) {
+            uint32_t crc, key_len, value_len;
+            memcpy(&crc, &data[offset], 4);
+            memcpy(&key_len, &data[offset + 4], 4);
+            memcpy(&value_len, &data[offset + 8], 4);
+            uint64_t len = kHeaderSize + (uint64_t)key_len + value_len;
+            if (len > data.size() - offset || crc32(&data[offset + 4], len - 4) != crc) break;
+            fn(data.substr(offset + kHeaderSize, key_len), data.substr(offset + kHeaderSize + key_len, value_len));
+            offset += len;
+            records++;
+        }
+        return records;
+    }
+
+private:
+    static constexpr size_t kHeaderSize = 12;
+
+    void process_logs() {
+        int fd = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+        while (true) {
+            unique_lock<ProfiledMutex> lock(queue_mutex_);
+            
+            cv_empty_.wait(lock, [this] { return !log_queue_.empty() || stop_flag_; });
+
+            if (stop_flag_ && log_queue_.empty()) break;
+
+            
+            queue<string> local_batch;
+            size_t count = 0;
+            
+            while (!log_queue_.empty() && count < batch_limit_) {
+                local_batch.push(move(log_queue_.front()));
+                log_queue_.pop();
+                count++;
+            }
+            
+            cv_full_.notify_all(); 
+            lock.unlock(); 
+
+            string batch_data;
+            while (!local_batch.empty()) {
+                batch_data += local_batch.front();
+                local_batch.pop();
+            }
+
+            if (fd != -1 && !batch_data.empty()) {
+                write(fd, batch_data.c_str(), batch_data.size());
+                KV_PROBE2(wal__batch__write, count, batch_data.size());
+                auto sync_start = chrono::steady_clock::now();
+                fdatasync(fd); 
+                auto sync_end = chrono::steady_clock::now();
+                stage_metrics().wal_fsync.record(sync_end - sync_start);
+                if (KV_PROBE_ENABLED(wal__fsync)) {
+                    KV_PROBE2(wal__fsync, chrono::duration_cast<chrono::nanoseconds>(sync_end - sync_start).count(), batch_data.size());
+                }
+            }
+        }
+        if (fd != -1) close(fd);
+    }
+
+    string path_;
+    queue<string> log_queue_;
+    ProfiledMutex queue_mutex_{"wal.queue"};
+    condition_variable_any cv_empty_;
+    condition_variable_any cv_full_;
+    bool stop_flag_;
+    size_t max_queue_size_;
+    size_t batch_limit_;
+    thread logger_thread_;
+};